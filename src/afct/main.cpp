@@ -1,10 +1,78 @@
+#include "batch.hpp"
+#include "cache.hpp"
 #include "eval.hpp"
 #include "prelude.hpp"
+#include "reload.hpp"
+#include "server.hpp"
+#include "snapshot.hpp"
+#include <charconv>
+#include <cstdlib>
+#include <csignal>
+#include <fmt/format.h>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
 
-void Repl()
+namespace {
+
+afct::Server* server = nullptr;
+
+void Stop(int)
+{
+  if (server)
+    server->stop();
+}
+
+bool ParseCount(std::string_view text, int64_t& count)
+{
+  auto end = text.data() + text.size();
+  auto [last, ec] = std::from_chars(text.data(), end, count);
+  return ec == std::errc() && last == end && count >= 0;
+}
+
+// one line per file, errors on stderr, then the summary
+int RunBatch(
+    std::vector<std::string> const& inputs,
+    size_t jobs,
+    std::shared_ptr<afct::Env> base,
+    std::chrono::milliseconds timeout)
+{
+  auto files = afct::CollectScripts(inputs);
+  auto start = std::chrono::steady_clock::now();
+  auto results = afct::RunBatch(files, jobs, std::move(base), timeout);
+  auto summary =
+      afct::Summarize(results, std::chrono::steady_clock::now() - start);
+
+  for (auto const& result : results)
+  {
+    if (result.ok)
+      std::cout << result.path.string() << ": " << result.value << "\n";
+    else
+      std::cerr << result.path.string() << ": " << result.error << "\n";
+  }
+
+  auto us = [](std::chrono::nanoseconds ns) { return ns.count() / 1000; };
+  std::cerr << fmt::format(
+      "{} files, {} failed in {:.3f} s, {:.0f} files/s, "
+      "latency p50 {} us, p99 {} us, max {} us\n",
+      summary.files,
+      summary.failed,
+      std::chrono::duration<double>(summary.wall).count(),
+      summary.per_second,
+      us(summary.p50),
+      us(summary.p99),
+      us(summary.max));
+  return summary.failed ? 1 : 0;
+}
+
+} // namespace
+
+void Repl(std::shared_ptr<afct::Env> env)
 {
-  auto env = afct::Prelude();
   while (true)
   {
     std::cout << "afct> ";
@@ -26,23 +94,155 @@ void Repl()
   }
 }
 
+// re-evaluates what changed each time the file is saved, until killed
+int Watch(std::filesystem::path const& file, std::shared_ptr<afct::Env> env)
+{
+  afct::Reloader reloader(file, std::move(env));
+  while (true)
+  {
+    if (reloader.stale())
+    {
+      auto start = std::chrono::steady_clock::now();
+      try
+      {
+        auto names = reloader.reload();
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::cerr << fmt::format(
+            "Reloaded {} in {:.1f} ms: {}\n",
+            file.string(),
+            elapsed.count(),
+            fmt::join(names, " "));
+      }
+      catch (afct::Exception const& e)
+      {
+        std::cerr << e.what() << std::endl;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+}
+
+int Usage(char const* program)
+{
+  std::cerr << "Usage: " << program
+            << " [--no-cache] [--load <image>] [--snapshot <image>]"
+            << " [--serve <socket> [--timeout <ms>] | --connect <socket>]"
+            << " [<file>]\n       " << program
+            << " [--no-cache] [--load <image>] --watch <file>\n       "
+            << program
+            << " [--no-cache] [--load <image>] --jobs <n> [--timeout <ms>]"
+            << " <file|dir|glob>..."
+            << std::endl;
+  return 1;
+}
+
 int main(int argc, char* argv[])
 {
-  if (argc > 2)
+  std::optional<std::filesystem::path> load;
+  std::optional<std::filesystem::path> snapshot;
+  std::optional<std::filesystem::path> serve;
+  std::optional<std::filesystem::path> connect;
+  std::optional<size_t> jobs;
+  bool watch = false;
+  std::vector<std::string> inputs;
+  afct::ServerOptions options;
+  // the library leaves the parse cache off
+  afct::ParseCache::Default().set_enabled(!std::getenv("AFCT_NO_CACHE"));
+  for (int i = 1; i < argc; i++)
   {
-    std::cerr << "Usage: " << argv[0] << " [<file>]" << std::endl;
-    return 1;
+    std::string_view arg = argv[i];
+    if (arg == "--no-cache")
+      afct::ParseCache::Default().set_enabled(false);
+    else if (arg == "--load" && i + 1 < argc)
+      load = argv[++i];
+    else if (arg == "--snapshot" && i + 1 < argc)
+      snapshot = argv[++i];
+    else if (arg == "--serve" && i + 1 < argc)
+      serve = argv[++i];
+    else if (arg == "--connect" && i + 1 < argc)
+      connect = argv[++i];
+    else if (arg == "--timeout" && i + 1 < argc)
+    {
+      int64_t ms = 0;
+      if (!ParseCount(argv[++i], ms))
+        return Usage(argv[0]);
+      options.timeout = std::chrono::milliseconds(ms);
+    }
+    else if (arg == "--watch")
+      watch = true;
+    else if (arg == "--jobs" && i + 1 < argc)
+    {
+      int64_t count = 0;
+      if (!ParseCount(argv[++i], count) || count == 0)
+        return Usage(argv[0]);
+      jobs = count;
+    }
+    else if (!arg.starts_with("--"))
+      inputs.emplace_back(arg);
+    else
+      return Usage(argv[0]);
   }
 
-  if (argc == 2)
+  if ((serve && connect) || (jobs && (serve || connect || snapshot)) ||
+      (jobs && inputs.empty()) || (!jobs && inputs.size() > 1) ||
+      (watch && (jobs || serve || connect || snapshot || inputs.empty())))
+    return Usage(argv[0]);
+
+  // many independent scripts in one process over one shared library env
+  if (jobs)
+    return RunBatch(
+        inputs,
+        *jobs,
+        load ? afct::ReadSnapshot(*load) : afct::Builtins(),
+        options.timeout);
+
+  std::optional<std::filesystem::path> file;
+  if (!inputs.empty())
+    file = inputs.front();
+
+  // sends the file, or stdin, to a running server and prints the result
+  if (connect)
   {
-    auto env = afct::Prelude();
-    afct::Eval(std::filesystem::path(argv[1]), env);
+    std::stringstream source;
+    if (file)
+      source << std::ifstream(*file).rdbuf();
+    else
+      source << std::cin.rdbuf();
+    try
+    {
+      std::cout << afct::Client(*connect).eval(source.str()) << std::endl;
+    }
+    catch (afct::Exception const& e)
+    {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
   }
-  else
+
+  // an image from --snapshot starts up without re-evaluating its sources
+  auto env = load ? afct::ReadSnapshot(*load) : afct::Prelude();
+  if (watch)
+    return Watch(*file, env);
+  if (file)
+    afct::Eval(*file, env);
+
+  if (serve)
   {
-    Repl();
+    // the library env is shared read-only by every request
+    options.base = env;
+    afct::Server instance(*serve, options);
+    server = &instance;
+    std::signal(SIGINT, Stop);
+    std::signal(SIGTERM, Stop);
+    instance.run();
+    server = nullptr;
   }
+  else if (snapshot)
+    afct::WriteSnapshot(env, *snapshot);
+  else if (!file)
+    Repl(env);
 
   return 0;
 }
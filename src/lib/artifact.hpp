@@ -1,9 +1,28 @@
+#include "async.hpp"
+#include "batch.hpp"
+#include "binary.hpp"
 #include "builder.hpp"
+#include "cache.hpp"
+#include "context.hpp"
+#include "csv.hpp"
+#include "cursor.hpp"
 #include "env.hpp"
 #include "eval.hpp"
 #include "expr.hpp"
 #include "function.hpp"
+#include "image.hpp"
+#include "json.hpp"
+#include "lazy.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
 #include "parse.hpp"
+#include "pool.hpp"
 #include "prelude.hpp"
 #include "querier.hpp"
+#include "reload.hpp"
+#include "scheduler.hpp"
+#include "server.hpp"
+#include "snapshot.hpp"
+#include "task.hpp"
+#include "transduce.hpp"
 #include "visitor.hpp"
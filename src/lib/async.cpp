@@ -0,0 +1,504 @@
+#include "async.hpp"
+
+#include "util.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <utility>
+
+namespace afct {
+
+namespace {
+
+thread_local EventLoop* current_loop = nullptr;
+thread_local Fuel* current_fuel = nullptr;
+
+// runs a task and reports its outcome, destroying itself when finished
+struct Detached
+{
+  struct promise_type
+  {
+    Detached get_return_object()
+    {
+      return {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+
+    std::suspend_always initial_suspend() const noexcept
+    {
+      return {};
+    }
+
+    std::suspend_never final_suspend() const noexcept
+    {
+      return {};
+    }
+
+    void return_void() const
+    {}
+
+    void unhandled_exception() const
+    {
+      std::terminate();
+    }
+  };
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+Detached Drive(AsyncExpr task, EventLoop::Done done, size_t& active)
+{
+  Expr result;
+  std::exception_ptr error;
+  try
+  {
+    result = co_await std::move(task);
+  }
+  catch (...)
+  {
+    error = std::current_exception();
+  }
+  active--;
+  done(std::move(result), error);
+}
+
+class Fd
+{
+public:
+  explicit Fd(int fd) : _fd(fd)
+  {}
+
+  ~Fd()
+  {
+    if (_fd >= 0)
+      close(_fd);
+  }
+
+  Fd(Fd const&) = delete;
+  Fd& operator=(Fd const&) = delete;
+
+  int get() const
+  {
+    return _fd;
+  }
+
+private:
+  int _fd;
+};
+
+std::string ErrnoMessage(std::string const& what)
+{
+  return fmt::format("{}: {}", what, std::strerror(errno));
+}
+
+} // namespace
+
+bool AsyncExpr::FinalAwaiter::await_ready() const noexcept
+{
+  return false;
+}
+
+void AsyncExpr::FinalAwaiter::await_suspend(Handle handle) noexcept
+{
+  auto& promise = handle.promise();
+  if (promise.running_inline)
+    return;
+
+  // finished after suspending, so the awaiter is waiting to be resumed;
+  // it may destroy this frame, which must not be touched afterwards
+  if (auto continuation = promise.continuation)
+    continuation.resume();
+}
+
+void AsyncExpr::FinalAwaiter::await_resume() const noexcept
+{}
+
+AsyncExpr AsyncExpr::promise_type::get_return_object()
+{
+  return AsyncExpr(Handle::from_promise(*this));
+}
+
+std::suspend_always AsyncExpr::promise_type::initial_suspend() const noexcept
+{
+  return {};
+}
+
+AsyncExpr::FinalAwaiter AsyncExpr::promise_type::final_suspend() const noexcept
+{
+  return {};
+}
+
+void AsyncExpr::promise_type::return_value(Expr result)
+{
+  value = std::move(result);
+}
+
+void AsyncExpr::promise_type::unhandled_exception()
+{
+  error = std::current_exception();
+}
+
+AsyncExpr::AsyncExpr(Handle handle)
+  : _handle(handle)
+{}
+
+AsyncExpr::AsyncExpr(AsyncExpr&& other) noexcept
+  : _handle(std::exchange(other._handle, nullptr))
+{}
+
+AsyncExpr& AsyncExpr::operator=(AsyncExpr&& other) noexcept
+{
+  if (this != &other)
+  {
+    if (_handle)
+      _handle.destroy();
+    _handle = std::exchange(other._handle, nullptr);
+  }
+  return *this;
+}
+
+AsyncExpr::~AsyncExpr()
+{
+  if (_handle)
+    _handle.destroy();
+}
+
+bool AsyncExpr::await_ready() const noexcept
+{
+  return false;
+}
+
+bool AsyncExpr::await_suspend(std::coroutine_handle<> awaiting)
+{
+  auto& promise = _handle.promise();
+  promise.continuation = awaiting;
+  promise.running_inline = true;
+  _handle.resume();
+  if (_handle.done())
+    return false;
+  promise.running_inline = false;
+  return true;
+}
+
+Expr AsyncExpr::await_resume()
+{
+  auto& promise = _handle.promise();
+  if (promise.error)
+    std::rethrow_exception(promise.error);
+  return std::move(promise.value);
+}
+
+bool AsyncExpr::done() const
+{
+  return _handle.done();
+}
+
+void AsyncExpr::resume()
+{
+  _handle.resume();
+}
+
+Fuel::Tick::Tick(Fuel& fuel)
+  : _fuel(fuel)
+{}
+
+bool Fuel::Tick::await_ready() noexcept
+{
+  if (_fuel._remaining.load(std::memory_order_relaxed) <= 0)
+    return false;
+  _fuel._remaining--;
+  _fuel._used++;
+  return true;
+}
+
+void Fuel::Tick::await_suspend(std::coroutine_handle<> handle) noexcept
+{
+  _fuel._preempted = handle;
+  _suspended = true;
+}
+
+void Fuel::Tick::await_resume() noexcept
+{
+  // the step that ran out is charged to the refill
+  if (_suspended)
+  {
+    _fuel._remaining--;
+    _fuel._used++;
+  }
+}
+
+Fuel::Scope::Scope(Fuel* fuel)
+  : _previous(std::exchange(current_fuel, fuel))
+{}
+
+Fuel::Scope::~Scope()
+{
+  current_fuel = _previous;
+}
+
+Fuel* Fuel::Current()
+{
+  return current_fuel;
+}
+
+Fuel::Tick Fuel::tick()
+{
+  return Tick(*this);
+}
+
+void Fuel::charge()
+{
+  auto used = _used.load(std::memory_order_relaxed);
+  auto limit = _limit.load(std::memory_order_relaxed);
+  AFCT_CHECK(
+      limit == 0 || used < limit,
+      fmt::format("Ran out of fuel after {} steps", used));
+  // the clock is only read every so often
+  AFCT_CHECK(
+      used % 256 != 0 ||
+          std::chrono::steady_clock::now() <
+              _deadline.load(std::memory_order_relaxed),
+      "Ran past the deadline");
+  auto cancel = _cancel.load(std::memory_order_relaxed);
+  AFCT_CHECK(
+      !cancel || !cancel->load(std::memory_order_relaxed), "Cancelled");
+  _remaining--;
+  _used++;
+}
+
+void Fuel::refuel(int64_t steps)
+{
+  _remaining += steps;
+}
+
+void Fuel::set_limit(uint64_t steps)
+{
+  _limit = steps;
+}
+
+void Fuel::set_deadline(std::chrono::steady_clock::time_point deadline)
+{
+  _deadline = deadline;
+}
+
+void Fuel::set_cancel(std::atomic<bool> const* cancel)
+{
+  _cancel = cancel;
+}
+
+int64_t Fuel::remaining() const
+{
+  return _remaining;
+}
+
+uint64_t Fuel::used() const
+{
+  return _used;
+}
+
+std::coroutine_handle<> Fuel::take_preempted()
+{
+  return std::exchange(_preempted, nullptr);
+}
+
+Expr IAsyncFunction::call(List& args, std::shared_ptr<Env> env)
+{
+  return BlockOn(call_async(args, env));
+}
+
+Readable::Readable(EventLoop& loop, int fd)
+  : _loop(loop)
+  , _fd(fd)
+{}
+
+bool Readable::await_ready() const noexcept
+{
+  return false;
+}
+
+void Readable::await_suspend(std::coroutine_handle<> handle)
+{
+  _handle = handle;
+  epoll_event event{};
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.ptr = this;
+  AFCT_CHECK(
+      epoll_ctl(_loop._epoll, EPOLL_CTL_ADD, _fd, &event) == 0,
+      ErrnoMessage("Failed to watch fd"));
+  _loop._waiting++;
+}
+
+void Readable::await_resume() const noexcept
+{}
+
+EventLoop::EventLoop()
+  : _epoll(epoll_create1(EPOLL_CLOEXEC))
+{
+  AFCT_CHECK(_epoll >= 0, ErrnoMessage("Failed to create epoll"));
+}
+
+EventLoop::~EventLoop()
+{
+  close(_epoll);
+}
+
+void EventLoop::spawn(AsyncExpr task, Done done)
+{
+  _active++;
+  post(Drive(std::move(task), std::move(done), _active).handle);
+}
+
+void EventLoop::post(std::coroutine_handle<> handle)
+{
+  _ready.push_back(handle);
+}
+
+void EventLoop::run()
+{
+  auto previous = std::exchange(current_loop, this);
+  try
+  {
+    epoll_event events[64];
+    while (_active > 0)
+    {
+      while (!_ready.empty())
+      {
+        auto handle = _ready.front();
+        _ready.pop_front();
+        handle.resume();
+      }
+      if (_active == 0)
+        break;
+
+      AFCT_CHECK(_waiting > 0, "Event loop stalled with no pending I/O");
+      auto n = epoll_wait(_epoll, events, 64, -1);
+      if (n < 0 && errno == EINTR)
+        continue;
+      AFCT_CHECK(n >= 0, ErrnoMessage("Failed to wait on epoll"));
+
+      for (int i = 0; i < n; i++)
+      {
+        auto readable = static_cast<Readable*>(events[i].data.ptr);
+        epoll_ctl(_epoll, EPOLL_CTL_DEL, readable->_fd, nullptr);
+        _waiting--;
+        post(readable->_handle);
+      }
+    }
+  }
+  catch (...)
+  {
+    current_loop = previous;
+    throw;
+  }
+  current_loop = previous;
+}
+
+size_t EventLoop::active() const
+{
+  return _active;
+}
+
+Readable EventLoop::readable(int fd)
+{
+  return Readable(*this, fd);
+}
+
+EventLoop* EventLoop::Current()
+{
+  return current_loop;
+}
+
+Expr BlockOn(AsyncExpr task)
+{
+  EventLoop loop;
+  Expr result;
+  std::exception_ptr error;
+  loop.spawn(std::move(task), [&](Expr value, std::exception_ptr e) {
+    result = std::move(value);
+    error = e;
+  });
+  loop.run();
+  if (error)
+    std::rethrow_exception(error);
+  return result;
+}
+
+AsyncExpr ReadAll(EventLoop& loop, int fd)
+{
+  // read straight into the result so suspended frames stay small
+  constexpr size_t kChunkSize = 1 << 14;
+  std::string result;
+  while (true)
+  {
+    auto size = result.size();
+    result.resize(size + kChunkSize);
+    auto n = read(fd, result.data() + size, kChunkSize);
+    result.resize(size + std::max<ssize_t>(n, 0));
+    if (n == 0)
+    {
+      co_return Expr{String{std::move(result)}};
+    }
+    else if (n > 0)
+    {
+      continue;
+    }
+    else if (errno == EAGAIN || errno == EWOULDBLOCK)
+    {
+      co_await loop.readable(fd);
+    }
+    else if (errno != EINTR)
+    {
+      AFCT_ERROR(ErrnoMessage("Failed to read"));
+    }
+  }
+}
+
+AsyncExpr Sleep(EventLoop& loop, std::chrono::milliseconds duration)
+{
+  Fd timer(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+  AFCT_CHECK(timer.get() >= 0, ErrnoMessage("Failed to create timer"));
+
+  // a zero it_value would disarm the timer instead of firing at once
+  auto ns = std::max<int64_t>(1, std::chrono::nanoseconds(duration).count());
+  itimerspec spec{};
+  spec.it_value.tv_sec = ns / 1'000'000'000;
+  spec.it_value.tv_nsec = ns % 1'000'000'000;
+  AFCT_CHECK(
+      timerfd_settime(timer.get(), 0, &spec, nullptr) == 0,
+      ErrnoMessage("Failed to set timer"));
+
+  co_await loop.readable(timer.get());
+  co_return Expr{};
+}
+
+AsyncExpr SleepFunction::call_async(List args, std::shared_ptr<Env>)
+{
+  AFCT_ARG_CHECK(
+      args.size() == 1 && args[0].is_numeric(),
+      "Expected 1 numeric arg to sleep");
+
+  auto loop = EventLoop::Current();
+  AFCT_CHECK(loop, "Expected sleep to run on an event loop");
+  auto ms = static_cast<int64_t>(args[0].get_numeric());
+  co_return co_await Sleep(*loop, std::chrono::milliseconds(ms));
+}
+
+AsyncExpr ReadFileFunction::call_async(List args, std::shared_ptr<Env>)
+{
+  AFCT_ARG_CHECK(
+      args.size() == 1 && args[0].is_string(),
+      "Expected 1 string arg to read-file");
+
+  auto loop = EventLoop::Current();
+  AFCT_CHECK(loop, "Expected read-file to run on an event loop");
+  auto const& path = args[0].get_string();
+  Fd file(open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC));
+  AFCT_CHECK(
+      file.get() >= 0, ErrnoMessage(fmt::format("Failed to open {}", path)));
+  co_return co_await ReadAll(*loop, file.get());
+}
+
+} // namespace afct
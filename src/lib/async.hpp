@@ -0,0 +1,208 @@
+#pragma once
+
+#include "function.hpp"
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+
+namespace afct {
+
+// lazily started coroutine producing an Expr; co_await runs it inline and
+// carries on directly if it finished without suspending, so long chains of
+// synchronous awaits do not grow the native stack
+class AsyncExpr
+{
+public:
+  struct promise_type;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  struct FinalAwaiter
+  {
+    bool await_ready() const noexcept;
+    void await_suspend(Handle handle) noexcept;
+    void await_resume() const noexcept;
+  };
+
+  struct promise_type
+  {
+    Expr value;
+    std::exception_ptr error;
+    std::coroutine_handle<> continuation;
+    // the awaiter is still inside its resume() call
+    bool running_inline{false};
+
+    AsyncExpr get_return_object();
+    std::suspend_always initial_suspend() const noexcept;
+    FinalAwaiter final_suspend() const noexcept;
+    void return_value(Expr result);
+    void unhandled_exception();
+  };
+
+  AsyncExpr(AsyncExpr&& other) noexcept;
+  AsyncExpr& operator=(AsyncExpr&& other) noexcept;
+  ~AsyncExpr();
+
+  bool await_ready() const noexcept;
+  bool await_suspend(std::coroutine_handle<> awaiting);
+  Expr await_resume();
+
+  // for drivers that start the coroutine themselves rather than await it
+  bool done() const;
+  void resume();
+
+private:
+  explicit AsyncExpr(Handle handle);
+
+  Handle _handle;
+};
+
+// native function that may suspend the calling script; from the
+// synchronous Eval it blocks on a private loop instead
+class IAsyncFunction : public INativeFunction
+{
+public:
+  virtual AsyncExpr call_async(List args, std::shared_ptr<Env> env) = 0;
+  Expr call(List& args, std::shared_ptr<Env> env) final;
+};
+
+// evaluation steps a script may take before it suspends; whoever drives
+// the script refuels it and resumes the preempted coroutine. Synchronous
+// evaluation inside builtins cannot suspend, so it charges the fuel current
+// on its thread instead, overdrawing the slice if need be, and throws once
+// past the limit or the deadline, or once cancelled
+class Fuel : public std::enable_shared_from_this<Fuel>
+{
+public:
+  class Tick
+  {
+  public:
+    explicit Tick(Fuel& fuel);
+    bool await_ready() noexcept;
+    void await_suspend(std::coroutine_handle<> handle) noexcept;
+    void await_resume() noexcept;
+
+  private:
+    Fuel& _fuel;
+    bool _suspended{false};
+  };
+
+  // makes fuel, which may be null, current on this thread for the scope
+  class Scope
+  {
+  public:
+    explicit Scope(Fuel* fuel);
+    ~Scope();
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+
+  private:
+    Fuel* _previous;
+  };
+
+  static Fuel* Current();
+
+  // charges one step, suspending when none are left
+  Tick tick();
+  // charges one synchronous step
+  void charge();
+  void refuel(int64_t steps);
+  // total steps past which synchronous steps throw, 0 for none
+  void set_limit(uint64_t steps);
+  void set_deadline(std::chrono::steady_clock::time_point deadline);
+  // synchronous steps throw once the flag is set
+  void set_cancel(std::atomic<bool> const* cancel);
+  int64_t remaining() const;
+  uint64_t used() const;
+  // coroutine suspended for want of fuel, if any
+  std::coroutine_handle<> take_preempted();
+
+private:
+  // work handed to other threads charges the same fuel, and reads the
+  // bounds while the driver may be changing them
+  std::atomic<int64_t> _remaining{0};
+  std::atomic<uint64_t> _used{0};
+  std::atomic<uint64_t> _limit{0};
+  std::atomic<std::chrono::steady_clock::time_point> _deadline{
+      std::chrono::steady_clock::time_point::max()};
+  std::atomic<std::atomic<bool> const*> _cancel{nullptr};
+  std::coroutine_handle<> _preempted;
+};
+
+class EventLoop;
+
+// suspends until fd is readable
+class Readable
+{
+public:
+  Readable(EventLoop& loop, int fd);
+  bool await_ready() const noexcept;
+  void await_suspend(std::coroutine_handle<> handle);
+  void await_resume() const noexcept;
+
+private:
+  friend class EventLoop;
+
+  EventLoop& _loop;
+  int _fd;
+  std::coroutine_handle<> _handle;
+};
+
+// single-threaded epoll loop driving suspended scripts
+class EventLoop
+{
+public:
+  using Done = std::function<void(Expr, std::exception_ptr)>;
+
+  EventLoop();
+  ~EventLoop();
+  EventLoop(EventLoop const&) = delete;
+  EventLoop& operator=(EventLoop const&) = delete;
+
+  // starts task on the next run; done is called on this thread
+  void spawn(AsyncExpr task, Done done);
+  // resumes handle on the next turn of the loop
+  void post(std::coroutine_handle<> handle);
+  // returns once every spawned task has finished
+  void run();
+  size_t active() const;
+
+  Readable readable(int fd);
+
+  // the loop running on this thread, if any
+  static EventLoop* Current();
+
+private:
+  friend class Readable;
+
+  int _epoll;
+  size_t _active{0};
+  size_t _waiting{0};
+  std::deque<std::coroutine_handle<>> _ready;
+};
+
+// runs task on a loop of its own and returns its result
+Expr BlockOn(AsyncExpr task);
+
+// reads fd to EOF, suspending whenever it would block
+AsyncExpr ReadAll(EventLoop& loop, int fd);
+AsyncExpr Sleep(EventLoop& loop, std::chrono::milliseconds duration);
+
+// (sleep ms)
+class SleepFunction final : public IAsyncFunction
+{
+public:
+  AsyncExpr call_async(List args, std::shared_ptr<Env> env) final;
+};
+
+// (read-file path), files opened non-blocking so pipes do not stall a loop
+class ReadFileFunction final : public IAsyncFunction
+{
+public:
+  AsyncExpr call_async(List args, std::shared_ptr<Env> env) final;
+};
+
+} // namespace afct
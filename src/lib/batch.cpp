@@ -0,0 +1,175 @@
+#include "batch.hpp"
+
+#include "context.hpp"
+#include "parse.hpp"
+#include "pool.hpp"
+#include "prelude.hpp"
+#include "scheduler.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <fmt/format.h>
+#include <fstream>
+#include <glob.h>
+
+namespace afct {
+
+namespace {
+
+std::vector<std::filesystem::path> Glob(std::string const& pattern)
+{
+  glob_t matches{};
+  auto status = ::glob(pattern.c_str(), 0, nullptr, &matches);
+  std::vector<std::filesystem::path> paths;
+  for (size_t i = 0; status == 0 && i < matches.gl_pathc; i++)
+    paths.emplace_back(matches.gl_pathv[i]);
+  ::globfree(&matches);
+  AFCT_CHECK(
+      status == 0 || status == GLOB_NOMATCH,
+      fmt::format("Failed to expand {}", pattern));
+  return paths;
+}
+
+// steps a script takes between checks of its timeout
+constexpr int64_t kSlice = 1000;
+
+// parses without the cache, which each file would only fill
+Expr Run(
+    std::filesystem::path const& path,
+    std::shared_ptr<Env> env,
+    std::chrono::milliseconds timeout)
+{
+  auto file = std::ifstream(path);
+  AFCT_CHECK(file.good(), fmt::format("Failed to open {}", path.string()));
+  std::string input(
+      (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  auto timed_out = [&] {
+    return timeout.count() && std::chrono::steady_clock::now() >= deadline;
+  };
+  try
+  {
+    Script script(Parse(std::move(input)), std::move(env));
+    // builtins that call back into the script are stopped by the fuel
+    if (timeout.count())
+      script.fuel().set_deadline(deadline);
+    while (!script.run(kSlice))
+      AFCT_CHECK(!timed_out(), "Timed out");
+    return script.result();
+  }
+  catch (Exception const&)
+  {
+    AFCT_CHECK(
+        !timed_out(),
+        fmt::format("Timed out after {} ms", timeout.count()));
+    throw;
+  }
+}
+
+} // namespace
+
+std::vector<std::filesystem::path> CollectScripts(
+    std::vector<std::string> const& inputs)
+{
+  std::vector<std::filesystem::path> files;
+  for (auto const& input : inputs)
+  {
+    std::filesystem::path path(input);
+    if (std::filesystem::is_directory(path))
+    {
+      std::vector<std::filesystem::path> found;
+      for (auto const& entry :
+           std::filesystem::recursive_directory_iterator(path))
+      {
+        if (entry.is_regular_file() && entry.path().extension() == ".lisp")
+          found.push_back(entry.path());
+      }
+      std::sort(found.begin(), found.end());
+      files.insert(files.end(), found.begin(), found.end());
+    }
+    else if (
+        !std::filesystem::exists(path) &&
+        input.find_first_of("*?[") != std::string::npos)
+    {
+      auto found = Glob(input);
+      AFCT_CHECK(!found.empty(), fmt::format("No files match {}", input));
+      files.insert(files.end(), found.begin(), found.end());
+    }
+    else
+    {
+      files.push_back(std::move(path));
+    }
+  }
+  return files;
+}
+
+std::vector<BatchResult> RunBatch(
+    std::vector<std::filesystem::path> const& files,
+    size_t jobs,
+    std::shared_ptr<Env> base,
+    std::chrono::milliseconds timeout)
+{
+  if (!base)
+    base = Builtins();
+  // tables in the base are shared by every file, so read-only
+  auto read_only = std::make_shared<ReadOnlyTables const>(base);
+
+  std::vector<BatchResult> results(files.size());
+  // the calling thread helps, so it makes up one of the jobs
+  ThreadPool pool(std::max<size_t>(jobs, 1) - 1);
+  ParallelFor(pool, files.size(), 1, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; i++)
+    {
+      auto& result = results[i];
+      result.path = files[i];
+      auto start = std::chrono::steady_clock::now();
+      try
+      {
+        ReadOnlyTables::Scope tables(read_only);
+        result.value = Run(files[i], Env::Make(base), timeout);
+        result.ok = true;
+      }
+      catch (std::exception const& e)
+      {
+        result.error = e.what();
+      }
+      result.elapsed = std::chrono::steady_clock::now() - start;
+    }
+  });
+  return results;
+}
+
+BatchSummary Summarize(
+    std::vector<BatchResult> const& results, std::chrono::nanoseconds wall)
+{
+  BatchSummary summary;
+  summary.files = results.size();
+  summary.wall = wall;
+  if (results.empty())
+    return summary;
+
+  std::vector<std::chrono::nanoseconds> latencies;
+  latencies.reserve(results.size());
+  for (auto const& result : results)
+  {
+    latencies.push_back(result.elapsed);
+    if (!result.ok)
+      summary.failed++;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  auto percentile = [&](size_t p) {
+    return latencies[(latencies.size() - 1) * p / 100];
+  };
+  summary.p50 = percentile(50);
+  summary.p99 = percentile(99);
+  summary.max = latencies.back();
+  if (wall.count() > 0)
+  {
+    auto seconds = std::chrono::duration<double>(wall).count();
+    summary.per_second = results.size() / seconds;
+  }
+  return summary;
+}
+
+} // namespace afct
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "env.hpp"
+#include "expr.hpp"
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace afct {
+
+struct BatchResult
+{
+  std::filesystem::path path;
+  bool ok{false};
+  Expr value;
+  std::string error;
+  std::chrono::nanoseconds elapsed{0};
+};
+
+struct BatchSummary
+{
+  size_t files{0};
+  size_t failed{0};
+  std::chrono::nanoseconds wall{0};
+  std::chrono::nanoseconds p50{0};
+  std::chrono::nanoseconds p99{0};
+  std::chrono::nanoseconds max{0};
+  double per_second{0.0};
+};
+
+// files as given, directories as every .lisp file below them, and
+// patterns that name no file expanded as globs; sorted within each input
+std::vector<std::filesystem::path> CollectScripts(
+    std::vector<std::string> const& inputs);
+
+// evaluates each file in its own env over base, the builtins when null,
+// on jobs threads; a failure, or a script still running after timeout
+// when non-zero, is recorded in its result, in input order
+std::vector<BatchResult> RunBatch(
+    std::vector<std::filesystem::path> const& files,
+    size_t jobs,
+    std::shared_ptr<Env> base = nullptr,
+    std::chrono::milliseconds timeout = {});
+
+BatchSummary Summarize(
+    std::vector<BatchResult> const& results, std::chrono::nanoseconds wall);
+
+} // namespace afct
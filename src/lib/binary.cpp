@@ -0,0 +1,338 @@
+#include "binary.hpp"
+
+#include "util.hpp"
+#include <cstring>
+#include <fmt/format.h>
+#include <vector>
+
+namespace afct {
+
+namespace {
+
+constexpr std::string_view kMagic = "AFCB";
+constexpr uint8_t kVersion = 1;
+
+enum Tag : uint8_t
+{
+  kNull,
+  kFalse,
+  kTrue,
+  kDouble,
+  kInt,
+  kString,
+  kStringRef,
+  kName,
+  kNameRef,
+  kList,
+  kTable
+};
+
+void PutVarint(std::string& out, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+class Reader
+{
+public:
+  explicit Reader(std::string_view data) : _data(data)
+  {}
+
+  bool done() const
+  {
+    return _pos == _data.size();
+  }
+
+  size_t remaining() const
+  {
+    return _data.size() - _pos;
+  }
+
+  uint8_t byte()
+  {
+    AFCT_CHECK(_pos < _data.size(), "Truncated binary expression");
+    return static_cast<uint8_t>(_data[_pos++]);
+  }
+
+  uint64_t varint()
+  {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+      auto b = byte();
+      value |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return value;
+    }
+    AFCT_ERROR("Malformed varint in binary expression");
+  }
+
+  std::string_view bytes(size_t size)
+  {
+    AFCT_CHECK(size <= remaining(), "Truncated binary expression");
+    auto result = _data.substr(_pos, size);
+    _pos += size;
+    return result;
+  }
+
+  // count of following items, each of which takes at least a byte
+  size_t count()
+  {
+    auto n = varint();
+    AFCT_CHECK(n <= remaining(), "Corrupt container size in binary expression");
+    return n;
+  }
+
+private:
+  std::string_view _data;
+  size_t _pos{0};
+};
+
+class Decoder
+{
+public:
+  Decoder(std::string_view data, Builder& builder)
+    : _reader(data), _builder(builder)
+  {}
+
+  void run()
+  {
+    auto magic = _reader.bytes(kMagic.size());
+    AFCT_CHECK(magic == kMagic, "Not a binary expression");
+    auto version = _reader.byte();
+    AFCT_CHECK(
+        version == kVersion,
+        fmt::format("Unsupported binary expression version {}", version));
+
+    struct Frame
+    {
+      size_t remaining;
+      bool table;
+      bool key_next;
+    };
+    std::vector<Frame> stack;
+
+    bool root = true;
+    while (root || !stack.empty())
+    {
+      if (!stack.empty())
+      {
+        auto& frame = stack.back();
+        if (frame.table && frame.key_next)
+        {
+          _builder.expr_key(scalar(_reader.byte()));
+          frame.key_next = false;
+          continue;
+        }
+        if (frame.remaining == 0)
+        {
+          if (frame.table)
+            _builder.end_table();
+          else
+            _builder.end_list();
+          stack.pop_back();
+          continue;
+        }
+
+        frame.remaining--;
+        frame.key_next = frame.table && frame.remaining > 0;
+      }
+      root = false;
+
+      auto tag = _reader.byte();
+      if (tag == kList)
+      {
+        auto n = _reader.count();
+        _builder.start_list(n);
+        stack.push_back({n, false, false});
+      }
+      else if (tag == kTable)
+      {
+        auto n = _reader.count();
+        _builder.start_table(n);
+        stack.push_back({n, true, n > 0});
+      }
+      else
+      {
+        _builder.expr_value(scalar(tag));
+      }
+    }
+
+    AFCT_CHECK(_reader.done(), "Unexpected bytes after binary expression");
+  }
+
+private:
+  Expr scalar(uint8_t tag)
+  {
+    switch (tag)
+    {
+    case kNull: return Expr{};
+    case kFalse: return Expr{false};
+    case kTrue: return Expr{true};
+    case kDouble:
+    {
+      auto bytes = _reader.bytes(8);
+      uint64_t bits = 0;
+      for (size_t i = 0; i < 8; i++)
+        bits |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[i]))
+            << (8 * i);
+      double d;
+      std::memcpy(&d, &bits, sizeof(d));
+      return Expr{d};
+    }
+    case kInt:
+    {
+      auto zigzag = _reader.varint();
+      auto i = static_cast<int64_t>(zigzag >> 1) ^
+          -static_cast<int64_t>(zigzag & 1);
+      return Expr{i};
+    }
+    case kString: return Expr{String{std::string(text())}};
+    case kStringRef: return Expr{String{std::string(ref())}};
+    case kName: return Expr{Name{std::string(text())}};
+    case kNameRef: return Expr{Name{std::string(ref())}};
+    default:
+      AFCT_ERROR(fmt::format("Unexpected tag {} in binary expression", tag));
+    }
+  }
+
+  std::string_view text()
+  {
+    auto value = _reader.bytes(_reader.varint());
+    _strings.push_back(value);
+    return value;
+  }
+
+  std::string_view ref()
+  {
+    auto index = _reader.varint();
+    AFCT_CHECK(
+        index < _strings.size(), "Bad string reference in binary expression");
+    return _strings[index];
+  }
+
+  Reader _reader;
+  Builder& _builder;
+  std::vector<std::string_view> _strings;
+};
+
+} // namespace
+
+BinaryEncoder::BinaryEncoder(std::string& out) : _out(out)
+{
+  _out.append(kMagic);
+  _out.push_back(static_cast<char>(kVersion));
+}
+
+void BinaryEncoder::null_value()
+{
+  _out.push_back(kNull);
+}
+
+void BinaryEncoder::bool_value(bool value)
+{
+  _out.push_back(value ? kTrue : kFalse);
+}
+
+void BinaryEncoder::double_value(double value)
+{
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  _out.push_back(kDouble);
+  for (size_t i = 0; i < 8; i++)
+    _out.push_back(static_cast<char>(bits >> (8 * i)));
+}
+
+void BinaryEncoder::int_value(int64_t value)
+{
+  _out.push_back(kInt);
+  auto zigzag = (static_cast<uint64_t>(value) << 1) ^
+      static_cast<uint64_t>(value >> 63);
+  PutVarint(_out, zigzag);
+}
+
+void BinaryEncoder::string_value(std::string const& value)
+{
+  text(kString, kStringRef, value);
+}
+
+void BinaryEncoder::name_value(std::string const& value)
+{
+  text(kName, kNameRef, value);
+}
+
+void BinaryEncoder::lambda_value(Lambda const&)
+{
+  AFCT_ERROR("Lambda not encodable");
+}
+
+void BinaryEncoder::builtin_value(Builtin const&)
+{
+  AFCT_ERROR("Builtin not encodable");
+}
+
+void BinaryEncoder::start_list(size_t size)
+{
+  _out.push_back(kList);
+  PutVarint(_out, size);
+}
+
+void BinaryEncoder::end_list()
+{}
+
+void BinaryEncoder::start_table(size_t size)
+{
+  _out.push_back(kTable);
+  PutVarint(_out, size);
+}
+
+void BinaryEncoder::start_key()
+{}
+
+void BinaryEncoder::end_key()
+{}
+
+void BinaryEncoder::end_table()
+{}
+
+void BinaryEncoder::text(uint8_t tag, uint8_t ref_tag, std::string const& value)
+{
+  auto [it, inserted] = _strings.try_emplace(value, _strings.size());
+  if (!inserted)
+  {
+    _out.push_back(ref_tag);
+    PutVarint(_out, it->second);
+    return;
+  }
+
+  _out.push_back(tag);
+  PutVarint(_out, value.size());
+  _out.append(value);
+}
+
+std::string Encode(Expr const& expr)
+{
+  std::string out;
+  BinaryEncoder encoder(out);
+  Visit(expr, encoder);
+  return out;
+}
+
+void Decode(std::string_view data, Builder& builder)
+{
+  Decoder(data, builder).run();
+}
+
+Expr Decode(std::string_view data)
+{
+  Builder builder;
+  Decode(data, builder);
+  return builder.take_expr();
+}
+
+} // namespace afct
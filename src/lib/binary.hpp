@@ -0,0 +1,45 @@
+#pragma once
+
+#include "builder.hpp"
+#include "expr.hpp"
+#include "visitor.hpp"
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace afct {
+
+// compact length-prefixed encoding of everything but lambdas and builtins
+class BinaryEncoder final : public IVisitor
+{
+public:
+  explicit BinaryEncoder(std::string& out);
+
+  void null_value() override;
+  void bool_value(bool value) override;
+  void double_value(double value) override;
+  void int_value(int64_t value) override;
+  void string_value(std::string const& value) override;
+  void name_value(std::string const& value) override;
+  void lambda_value(Lambda const& value) override;
+  void builtin_value(Builtin const& value) override;
+  void start_list(size_t size) override;
+  void end_list() override;
+  void start_table(size_t size) override;
+  void start_key() override;
+  void end_key() override;
+  void end_table() override;
+
+private:
+  void text(uint8_t tag, uint8_t ref_tag, std::string const& value);
+
+  std::string& _out;
+  // repeated strings and names are written as references into this table
+  std::unordered_map<std::string_view, uint64_t> _strings;
+};
+
+std::string Encode(Expr const& expr);
+void Decode(std::string_view data, Builder& builder);
+Expr Decode(std::string_view data);
+
+} // namespace afct
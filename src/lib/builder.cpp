@@ -6,6 +6,9 @@
 
 namespace afct {
 
+Builder::Builder(std::pmr::memory_resource* resource) : _resource(resource)
+{}
+
 bool Builder::null_value()
 {
   return push(Expr{});
@@ -83,13 +86,21 @@ void Builder::expr_key(Expr key)
 
 bool Builder::start_list()
 {
-  auto expr = Expr{List{}};
-  return push(std::move(expr));
+  return start_list(0);
+}
+
+bool Builder::start_list(size_t size)
+{
+  List list;
+  list.reserve(size);
+  if (_resource)
+    return push(Expr{std::move(list), _resource});
+  return push(Expr{std::move(list)});
 }
 
 bool Builder::end_list()
 {
-  if (_stack.empty() || !_stack.back().is_list())
+  if (_stack.empty() || !_stack.back()->is_list())
     return false;
 
   _stack.pop_back();
@@ -98,13 +109,21 @@ bool Builder::end_list()
 
 bool Builder::start_table()
 {
-  auto expr = Expr{Table{}};
-  return push(std::move(expr));
+  return start_table(0);
+}
+
+bool Builder::start_table(size_t size)
+{
+  Table table;
+  table.reserve(size);
+  if (_resource)
+    return push(Expr{std::move(table), _resource});
+  return push(Expr{std::move(table)});
 }
 
 bool Builder::end_table()
 {
-  if (_stack.empty() || !_stack.back().is_table())
+  if (_stack.empty() || !_stack.back()->is_table())
     return false;
 
   _stack.pop_back();
@@ -121,26 +140,40 @@ Expr Builder::get_expr() const
   return _root;
 }
 
-bool Builder::push(Expr expr)
+Expr Builder::take_expr()
+{
+  _stack.clear();
+  _key = Expr();
+  auto root = std::move(_root);
+  _root = Expr();
+  return root;
+}
+
+bool Builder::push(Expr&& expr)
 {
   if (_stack.empty())
   {
-    _root = expr;
-    _stack.push_back(_root);
+    _root = std::move(expr);
+    _stack.push_back(&_root);
     return true;
   }
 
-  auto& current = _stack.back();
+  auto& current = *_stack.back();
+  Expr* inserted = nullptr;
   if (current.is_list())
   {
-    current.get_list().push_back(expr);
+    auto& list = current.get_list();
+    list.push_back(std::move(expr));
+    inserted = &list.back();
   }
   else if (current.is_table())
   {
     if (_key.get_type() == Type::Null)
       return false;
 
-    current.get_table()[_key] = expr;
+    auto result =
+        current.get_table().insert_or_assign(std::move(_key), std::move(expr));
+    inserted = &result.first->second;
     _key = Expr();
   }
   else
@@ -148,8 +181,9 @@ bool Builder::push(Expr expr)
     return false;
   }
 
-  if (expr.is_list() || expr.is_table())
-    _stack.push_back(expr);
+  // containers stay open until their end call
+  if (inserted->is_list() || inserted->is_table())
+    _stack.push_back(inserted);
 
   return true;
 }
@@ -1,12 +1,19 @@
 #pragma once
 
 #include "expr.hpp"
+#include <memory_resource>
 
 namespace afct {
 
 class Builder
 {
 public:
+  Builder() = default;
+  // each list and table node, its control block and container header,
+  // comes from resource, which must outlive the result; their elements
+  // and buckets still use the default allocator, as List and Table do
+  explicit Builder(std::pmr::memory_resource* resource);
+
   bool null_value();
   bool bool_value(bool value);
   bool double_value(double value);
@@ -21,18 +28,24 @@ public:
   void name_key(std::string key);
   void expr_key(Expr key);
   bool start_list();
+  bool start_list(size_t size);
   bool end_list();
   bool start_table();
+  bool start_table(size_t size);
   bool end_table();
   std::string get_string() const;
   Expr get_expr() const;
+  // moves the result out and resets the builder
+  Expr take_expr();
 
 private:
-  bool push(Expr expr);
+  bool push(Expr&& expr);
 
-  std::vector<Expr> _stack;
+  // open containers, pointing into _root
+  std::vector<Expr*> _stack;
   Expr _root;
   Expr _key;
+  std::pmr::memory_resource* _resource{nullptr};
 };
 
 } // namespace afct
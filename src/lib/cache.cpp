@@ -0,0 +1,251 @@
+#include "cache.hpp"
+
+#include "binary.hpp"
+#include "parse.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace afct {
+
+namespace {
+
+// header is magic, version, build, source size, then the source and the
+// encoded form
+constexpr uint64_t kMagic = 0x53524150'54434641; // "AFCTPARS"
+// bump whenever the entry layout changes
+constexpr uint64_t kVersion = 2;
+constexpr uint64_t kHeaderSize = 32;
+
+// identifies the library binary by its size and modification time, so a
+// rebuild with a changed parser or encoding never reads older entries
+uint64_t BuildId()
+{
+  static uint64_t const id = []() -> uint64_t {
+    Dl_info info;
+    struct stat status;
+    if (::dladdr(reinterpret_cast<void*>(&BuildId), &info) == 0 ||
+        !info.dli_fname || ::stat(info.dli_fname, &status) != 0)
+      return 0;
+    return static_cast<uint64_t>(status.st_size) * 1000000007ull ^
+        static_cast<uint64_t>(status.st_mtim.tv_sec) * 1000000000ull ^
+        static_cast<uint64_t>(status.st_mtim.tv_nsec);
+  }();
+  return id;
+}
+
+// names the entry; a collision only costs a miss as the source is compared
+uint64_t HashSource(std::string const& source)
+{
+  auto hash = 14695981039346656037ull ^ kVersion ^ BuildId();
+  for (auto c : source)
+  {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+uint64_t Word(char const* data)
+{
+  uint64_t result = 0;
+  for (size_t i = 0; i < 8; i++)
+    result |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+  return result;
+}
+
+void PutWord(std::string& out, uint64_t word)
+{
+  for (size_t i = 0; i < 8; i++)
+    out.push_back(static_cast<char>(word >> (8 * i)));
+}
+
+char const* NonEmpty(char const* value)
+{
+  return value && *value ? value : nullptr;
+}
+
+} // namespace
+
+ParseCache::ParseCache(
+    std::filesystem::path dir, bool enabled, uintmax_t max_bytes)
+  : _dir(std::move(dir))
+  , _max_bytes(max_bytes)
+  , _enabled(enabled && !_dir.empty())
+{}
+
+ParseCache& ParseCache::Default()
+{
+  static ParseCache cache(DefaultDir(), false);
+  return cache;
+}
+
+std::filesystem::path ParseCache::DefaultDir()
+{
+  if (auto dir = NonEmpty(std::getenv("AFCT_CACHE_DIR")))
+    return dir;
+  // the XDG spec has relative paths ignored
+  if (auto dir = NonEmpty(std::getenv("XDG_CACHE_HOME"));
+      dir && std::filesystem::path(dir).is_absolute())
+    return std::filesystem::path(dir) / "afct";
+  if (auto home = NonEmpty(std::getenv("HOME")))
+    return std::filesystem::path(home) / ".cache" / "afct";
+  return {};
+}
+
+Expr ParseCache::parse(std::string source)
+{
+  if (!enabled())
+    return Parse(std::move(source));
+
+  auto path = entry(source);
+  if (auto cached = load(path, source))
+    return *cached;
+
+  auto expr = Parse(source);
+  store(path, source, expr);
+  return expr;
+}
+
+std::filesystem::path ParseCache::entry(std::string const& source) const
+{
+  return _dir / fmt::format("{:016x}.afc", HashSource(source));
+}
+
+bool ParseCache::enabled() const
+{
+  return _enabled;
+}
+
+void ParseCache::set_enabled(bool enabled)
+{
+  _enabled = enabled && !_dir.empty();
+}
+
+std::optional<Expr> ParseCache::load(
+    std::filesystem::path const& path, std::string const& source) const
+{
+  auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return std::nullopt;
+
+  struct stat status;
+  void* mapping = MAP_FAILED;
+  size_t length = 0;
+  if (::fstat(fd, &status) == 0 &&
+      static_cast<uint64_t>(status.st_size) >= kHeaderSize + source.size())
+  {
+    length = status.st_size;
+    mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+
+  std::optional<Expr> result;
+  auto data = static_cast<char const*>(mapping);
+  if (mapping != MAP_FAILED && Word(data) == kMagic &&
+      Word(data + 8) == kVersion && Word(data + 16) == BuildId() &&
+      Word(data + 24) == source.size() &&
+      std::string_view(data + kHeaderSize, source.size()) == source)
+  {
+    // a damaged entry is just a miss, and gets rewritten
+    try
+    {
+      auto encoded = kHeaderSize + source.size();
+      result = Decode(std::string_view(data + encoded, length - encoded));
+      // a hit counts as a use for eviction
+      ::futimens(fd, nullptr);
+    }
+    catch (Exception const&)
+    {}
+  }
+  if (mapping != MAP_FAILED)
+    ::munmap(mapping, length);
+  ::close(fd);
+  return result;
+}
+
+void ParseCache::store(
+    std::filesystem::path const& path,
+    std::string const& source,
+    Expr const& expr) const
+{
+  static std::atomic<uint64_t> counter{0};
+
+  std::string data;
+  PutWord(data, kMagic);
+  PutWord(data, kVersion);
+  PutWord(data, BuildId());
+  PutWord(data, source.size());
+  data += source;
+  data += Encode(expr);
+
+  // written aside and renamed into place, so readers never see half of it
+  std::error_code error;
+  std::filesystem::create_directories(_dir, error);
+  auto temp = path;
+  temp += fmt::format(".{}.{}.tmp", ::getpid(), counter++);
+  {
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+    if (!file.good())
+    {
+      file.close();
+      std::filesystem::remove(temp, error);
+      return;
+    }
+  }
+  std::filesystem::rename(temp, path, error);
+  if (error)
+    std::filesystem::remove(temp, error);
+  evict();
+}
+
+void ParseCache::evict() const
+{
+  struct Entry
+  {
+    std::filesystem::file_time_type used;
+    uintmax_t size;
+    std::filesystem::path path;
+  };
+
+  std::vector<Entry> entries;
+  uintmax_t total = 0;
+  std::error_code error;
+  for (std::filesystem::directory_iterator it(_dir, error), end;
+       !error && it != end;
+       it.increment(error))
+  {
+    if (it->path().extension() != ".afc")
+      continue;
+    std::error_code ignored;
+    auto size = it->file_size(ignored);
+    auto used = it->last_write_time(ignored);
+    if (ignored)
+      continue;
+    total += size;
+    entries.push_back({used, size, it->path()});
+  }
+  if (total <= _max_bytes)
+    return;
+
+  std::sort(entries.begin(), entries.end(), [](auto& lhs, auto& rhs) {
+    return lhs.used < rhs.used;
+  });
+  for (auto const& entry : entries)
+  {
+    if (total <= _max_bytes)
+      break;
+    if (std::filesystem::remove(entry.path, error))
+      total -= entry.size;
+  }
+}
+
+} // namespace afct
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "expr.hpp"
+#include <atomic>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace afct {
+
+// parsed source kept on disk, keyed by a hash of the text and the build of
+// the library, so unchanged scripts skip lexing and parsing; entries keep
+// the source to compare on load, are written by rename, and the least
+// recently used go once the directory grows past max_bytes; any cache
+// failure falls back to Parse
+class ParseCache
+{
+public:
+  static constexpr uintmax_t kMaxBytes = 64 << 20;
+
+  explicit ParseCache(
+      std::filesystem::path dir,
+      bool enabled = true,
+      uintmax_t max_bytes = kMaxBytes);
+
+  // off until enabled, as by afct, so library users never write to disk
+  // unasked
+  static ParseCache& Default();
+  // AFCT_CACHE_DIR, else $XDG_CACHE_HOME/afct or ~/.cache/afct; empty or
+  // relative XDG_CACHE_HOME is ignored, and empty when there is no home
+  static std::filesystem::path DefaultDir();
+
+  Expr parse(std::string source);
+  std::filesystem::path entry(std::string const& source) const;
+  bool enabled() const;
+  void set_enabled(bool enabled);
+
+private:
+  std::optional<Expr> load(
+      std::filesystem::path const& path, std::string const& source) const;
+  void store(
+      std::filesystem::path const& path,
+      std::string const& source,
+      Expr const& expr) const;
+  // drops the oldest entries until the directory fits
+  void evict() const;
+
+  std::filesystem::path _dir;
+  uintmax_t _max_bytes;
+  std::atomic<bool> _enabled;
+};
+
+} // namespace afct
@@ -0,0 +1,154 @@
+#include "context.hpp"
+
+#include "function.hpp"
+#include "prelude.hpp"
+#include <utility>
+
+namespace afct {
+
+namespace {
+
+thread_local std::shared_ptr<ReadOnlyTables const> current_read_only;
+
+using Tables = std::unordered_set<Table const*>;
+using Envs = std::unordered_set<Env const*>;
+
+void Collect(Expr const& expr, Tables& tables, Envs& envs);
+
+void Collect(std::shared_ptr<Env> const& env, Tables& tables, Envs& envs)
+{
+  for (auto e = env.get(); e && envs.insert(e).second; e = e->outer().get())
+  {
+    for (auto const& binding : e->bindings())
+      Collect(binding.second, tables, envs);
+  }
+}
+
+void Collect(Expr const& expr, Tables& tables, Envs& envs)
+{
+  if (expr.is_list())
+  {
+    for (auto const& item : expr.get_list())
+      Collect(item, tables, envs);
+  }
+  else if (expr.is_table())
+  {
+    auto const& table = expr.get_table();
+    if (!tables.insert(&table).second)
+      return;
+    for (auto const& pair : table)
+    {
+      Collect(pair.first, tables, envs);
+      Collect(pair.second, tables, envs);
+    }
+  }
+  else if (expr.is_lambda())
+  {
+    // a quoted table in the body is handed out as is
+    Collect(expr.get_lambda().body, tables, envs);
+    Collect(expr.get_lambda().env, tables, envs);
+  }
+}
+
+} // namespace
+
+ReadOnlyTables::Scope::Scope(std::shared_ptr<ReadOnlyTables const> tables)
+  : _previous(std::exchange(current_read_only, std::move(tables)))
+{}
+
+ReadOnlyTables::Scope::~Scope()
+{
+  current_read_only = std::move(_previous);
+}
+
+std::shared_ptr<ReadOnlyTables const> const& ReadOnlyTables::Current()
+{
+  return current_read_only;
+}
+
+ReadOnlyTables::ReadOnlyTables(std::shared_ptr<Env> const& env)
+{
+  Envs envs;
+  Collect(env, _tables, envs);
+}
+
+bool ReadOnlyTables::contains(Table const& table) const
+{
+  return _tables.contains(&table);
+}
+
+size_t ReadOnlyTables::size() const
+{
+  return _tables.size();
+}
+
+ContextPool::Lease::Lease(ContextPool* pool, std::shared_ptr<Env> env)
+  : _pool(pool), _env(std::move(env))
+{}
+
+ContextPool::Lease::Lease(Lease&& other) noexcept
+  : _pool(std::exchange(other._pool, nullptr)), _env(std::move(other._env))
+{}
+
+ContextPool::Lease::~Lease()
+{
+  if (_pool)
+    _pool->release(std::move(_env));
+}
+
+std::shared_ptr<Env> const& ContextPool::Lease::env() const
+{
+  return _env;
+}
+
+ContextPool::ContextPool(
+    size_t warm, size_t max_idle, std::shared_ptr<Env> base)
+  : _base(base ? std::move(base) : Builtins())
+  , _read_only(std::make_shared<ReadOnlyTables>(_base))
+  , _max_idle(max_idle)
+{
+  _idle.reserve(warm);
+  for (size_t i = 0; i < warm; i++)
+    _idle.push_back(Env::Make(_base));
+}
+
+ContextPool::Lease ContextPool::acquire()
+{
+  {
+    std::lock_guard lock(_mutex);
+    if (!_idle.empty())
+    {
+      auto env = std::move(_idle.back());
+      _idle.pop_back();
+      return Lease(this, std::move(env));
+    }
+  }
+  return Lease(this, Env::Make(_base));
+}
+
+size_t ContextPool::idle() const
+{
+  std::lock_guard lock(_mutex);
+  return _idle.size();
+}
+
+std::shared_ptr<ReadOnlyTables const> const& ContextPool::read_only() const
+{
+  return _read_only;
+}
+
+void ContextPool::release(std::shared_ptr<Env> env)
+{
+  // also breaks the cycle a recursive define makes through the env
+  env->clear();
+  // still held by an escaped lambda, so it can't be handed out again, or
+  // shared by a spawn, which makes its sets slow
+  if (env.use_count() > 1 || env->shared())
+    return;
+
+  std::lock_guard lock(_mutex);
+  if (_idle.size() < _max_idle)
+    _idle.push_back(std::move(env));
+}
+
+} // namespace afct
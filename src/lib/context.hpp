@@ -0,0 +1,86 @@
+#pragma once
+
+#include "env.hpp"
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace afct {
+
+// tables reachable from a shared env, which set! refuses on a thread inside
+// a Scope over them: tables are unsynchronized maps, so a write by one
+// request would race with the others' reads and leak into later requests
+class ReadOnlyTables
+{
+public:
+  class Scope
+  {
+  public:
+    explicit Scope(std::shared_ptr<ReadOnlyTables const> tables);
+    ~Scope();
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+
+  private:
+    std::shared_ptr<ReadOnlyTables const> _previous;
+  };
+
+  static std::shared_ptr<ReadOnlyTables const> const& Current();
+
+  // walks env and its outers, lists, tables and lambda closures; tables
+  // added to env afterwards are not covered
+  explicit ReadOnlyTables(std::shared_ptr<Env> const& env);
+  bool contains(Table const& table) const;
+  size_t size() const;
+
+private:
+  std::unordered_set<Table const*> _tables;
+};
+
+// envs on top of a shared base, the builtins by default, kept warm between
+// requests; a returned env is cleared and reused, keeping its storage
+class ContextPool
+{
+public:
+  // hands its env back when destroyed; the pool must outlive it
+  class Lease
+  {
+  public:
+    Lease(Lease&& other) noexcept;
+    Lease& operator=(Lease&&) = delete;
+    ~Lease();
+
+    std::shared_ptr<Env> const& env() const;
+
+  private:
+    friend class ContextPool;
+    Lease(ContextPool* pool, std::shared_ptr<Env> env);
+
+    ContextPool* _pool;
+    std::shared_ptr<Env> _env;
+  };
+
+  // base is only read from, so it must not be changed while leases are out
+  explicit ContextPool(
+      size_t warm = 0,
+      size_t max_idle = 64,
+      std::shared_ptr<Env> base = nullptr);
+
+  // lambdas that escape a lease see its env cleared once it is returned
+  Lease acquire();
+  size_t idle() const;
+  // tables in the base, to be made read-only while a lease evaluates
+  std::shared_ptr<ReadOnlyTables const> const& read_only() const;
+
+private:
+  void release(std::shared_ptr<Env> env);
+
+  std::shared_ptr<Env> _base;
+  std::shared_ptr<ReadOnlyTables const> _read_only;
+  size_t _max_idle;
+  mutable std::mutex _mutex;
+  std::vector<std::shared_ptr<Env>> _idle;
+};
+
+} // namespace afct
@@ -0,0 +1,349 @@
+#include "csv.hpp"
+
+#include "util.hpp"
+#include <algorithm>
+#include <charconv>
+#include <fmt/format.h>
+#include <fstream>
+#include <sstream>
+
+namespace afct {
+
+namespace {
+
+enum class ColumnType
+{
+  Bool,
+  Int,
+  Double,
+  String
+};
+
+bool IsInt(std::string const& field)
+{
+  int64_t i;
+  auto last = field.data() + field.size();
+  auto [end, ec] = std::from_chars(field.data(), last, i);
+  return ec == std::errc() && end == last;
+}
+
+// numeric literals only, not the nan and inf from_chars also takes
+bool IsDouble(std::string const& field)
+{
+  if (field.find_first_not_of("0123456789+-.eE") != std::string::npos ||
+      field.find_first_of("0123456789") == std::string::npos)
+    return false;
+
+  double d;
+  auto last = field.data() + field.size();
+  auto [end, ec] = std::from_chars(field.data(), last, d);
+  return ec == std::errc() && end == last;
+}
+
+bool IsBool(std::string const& field)
+{
+  return field == "true" || field == "false";
+}
+
+// narrows as fields are seen; empty fields fit any type
+class Column
+{
+public:
+  void see(std::string const& field)
+  {
+    if (field.empty())
+      return;
+
+    if (_empty)
+    {
+      _empty = false;
+      _type = IsBool(field) ? ColumnType::Bool
+          : IsInt(field)    ? ColumnType::Int
+          : IsDouble(field) ? ColumnType::Double
+                            : ColumnType::String;
+      return;
+    }
+
+    if (_type == ColumnType::String)
+      return;
+    if (_type == ColumnType::Bool && !IsBool(field))
+      _type = ColumnType::String;
+    else if (_type == ColumnType::Int && !IsInt(field))
+      _type = IsDouble(field) ? ColumnType::Double : ColumnType::String;
+    else if (_type == ColumnType::Double && !IsDouble(field))
+      _type = ColumnType::String;
+  }
+
+  ColumnType type() const
+  {
+    return _empty ? ColumnType::String : _type;
+  }
+
+private:
+  bool _empty{true};
+  ColumnType _type{ColumnType::String};
+};
+
+Expr Convert(std::string field, ColumnType type)
+{
+  if (type == ColumnType::String)
+    return Expr{String{std::move(field)}};
+  if (field.empty())
+    return Expr{};
+
+  auto last = field.data() + field.size();
+  if (type == ColumnType::Bool)
+    return Expr{field == "true"};
+  if (type == ColumnType::Int)
+  {
+    int64_t i = 0;
+    std::from_chars(field.data(), last, i);
+    return Expr{i};
+  }
+  double d = 0.0;
+  std::from_chars(field.data(), last, d);
+  return Expr{d};
+}
+
+} // namespace
+
+CsvReader::CsvReader(
+    CsvOptions options, std::function<void(CsvRow const&)> callback)
+  : _options(options), _callback(std::move(callback))
+{}
+
+void CsvReader::feed(std::string_view chunk)
+{
+  auto delimiter = _options.delimiter;
+  auto quote = _options.quote;
+
+  for (size_t i = 0; i < chunk.size(); i++)
+  {
+    auto c = chunk[i];
+
+    if (_pending_cr)
+    {
+      _pending_cr = false;
+      if (c == '\n')
+        continue;
+    }
+
+    if (_state == State::Quoted)
+    {
+      // copy the run up to the next quote in one go
+      auto end = chunk.find(quote, i);
+      if (end == std::string_view::npos)
+        end = chunk.size();
+      _row[_fields].append(chunk.substr(i, end - i));
+      i = end;
+      if (end < chunk.size())
+        _state = State::QuoteInQuoted;
+      continue;
+    }
+
+    if (_state == State::FieldStart)
+    {
+      // blank lines are skipped
+      if (_fields == 0 && (c == '\n' || c == '\r'))
+      {
+        _pending_cr = c == '\r';
+        continue;
+      }
+      if (_fields == _row.size())
+        _row.emplace_back();
+      _row[_fields].clear();
+
+      if (c == quote)
+      {
+        _state = State::Quoted;
+        continue;
+      }
+      _state = State::Unquoted;
+    }
+    else if (_state == State::QuoteInQuoted)
+    {
+      if (c == quote)
+      {
+        _row[_fields] += quote;
+        _state = State::Quoted;
+        continue;
+      }
+      _state = State::Unquoted;
+      AFCT_CHECK(
+          c == delimiter || c == '\n' || c == '\r',
+          fmt::format("Unexpected {} after closing quote in CSV", c));
+    }
+
+    if (c == delimiter)
+    {
+      end_field();
+    }
+    else if (c == '\n' || c == '\r')
+    {
+      _pending_cr = c == '\r';
+      end_row();
+    }
+    else
+    {
+      _row[_fields] += c;
+    }
+  }
+}
+
+void CsvReader::finish()
+{
+  AFCT_CHECK(_state != State::Quoted, "Unterminated quoted field in CSV");
+  if (_state != State::FieldStart || _fields > 0)
+    end_row();
+}
+
+void CsvReader::end_field()
+{
+  if (_state == State::FieldStart)
+  {
+    if (_fields == _row.size())
+      _row.emplace_back();
+    _row[_fields].clear();
+  }
+  _fields++;
+  _state = State::FieldStart;
+}
+
+void CsvReader::end_row()
+{
+  end_field();
+  _row.resize(_fields);
+  _callback(_row);
+  _fields = 0;
+}
+
+void ReadCsv(
+    std::istream& input,
+    CsvOptions const& options,
+    std::function<void(CsvRow const&)> callback,
+    size_t chunk_size)
+{
+  CsvReader reader(options, std::move(callback));
+  std::string buffer(chunk_size, '\0');
+  while (input)
+  {
+    input.read(buffer.data(), buffer.size());
+    reader.feed(std::string_view(buffer.data(), input.gcount()));
+  }
+  reader.finish();
+}
+
+void ReadCsv(
+    std::filesystem::path const& path,
+    CsvOptions const& options,
+    std::function<void(CsvRow const&)> callback)
+{
+  std::ifstream file(path, std::ios::binary);
+  AFCT_CHECK(file.good(), fmt::format("Failed to open {}", path.string()));
+  ReadCsv(file, options, std::move(callback));
+}
+
+namespace {
+
+Expr Collect(
+    CsvOptions const& options, std::function<void(CsvReader&)> read)
+{
+  std::vector<Expr> names;
+  std::vector<std::vector<std::string>> fields;
+  std::vector<Column> columns;
+  size_t rows = 0;
+
+  CsvReader reader(options, [&](CsvRow const& row) {
+    if (options.header && names.empty())
+    {
+      for (auto const& name : row)
+      {
+        Expr key{String{name}};
+        AFCT_CHECK(
+            std::find(names.begin(), names.end(), key) == names.end(),
+            fmt::format("Duplicate CSV column {}", key));
+        names.push_back(std::move(key));
+      }
+      fields.resize(names.size());
+      columns.resize(names.size());
+      return;
+    }
+    if (names.empty())
+    {
+      for (size_t i = 0; i < row.size(); i++)
+        names.push_back(Expr{static_cast<int64_t>(i)});
+      fields.resize(names.size());
+      columns.resize(names.size());
+    }
+
+    AFCT_CHECK(
+        row.size() == names.size(),
+        fmt::format(
+            "CSV row {} has {} fields but expected {}",
+            rows + 1,
+            row.size(),
+            names.size()));
+    for (size_t i = 0; i < row.size(); i++)
+    {
+      if (options.infer_types)
+        columns[i].see(row[i]);
+      fields[i].push_back(row[i]);
+    }
+    rows++;
+  });
+  read(reader);
+  reader.finish();
+
+  std::vector<ColumnType> types;
+  for (auto const& column : columns)
+    types.push_back(column.type());
+
+  if (options.columns)
+  {
+    Table table;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+      List list;
+      list.reserve(rows);
+      for (auto& field : fields[i])
+        list.push_back(Convert(std::move(field), types[i]));
+      table[names[i]] = Expr{std::move(list)};
+    }
+    return Expr{std::move(table)};
+  }
+
+  List list;
+  list.reserve(rows);
+  for (size_t r = 0; r < rows; r++)
+  {
+    Table table;
+    table.reserve(names.size());
+    for (size_t i = 0; i < names.size(); i++)
+      table[names[i]] = Convert(std::move(fields[i][r]), types[i]);
+    list.push_back(Expr{std::move(table)});
+  }
+  return Expr{std::move(list)};
+}
+
+} // namespace
+
+Expr ReadCsv(std::filesystem::path const& path, CsvOptions const& options)
+{
+  std::ifstream file(path, std::ios::binary);
+  AFCT_CHECK(file.good(), fmt::format("Failed to open {}", path.string()));
+  return Collect(options, [&](CsvReader& reader) {
+    std::string buffer(1 << 16, '\0');
+    while (file)
+    {
+      file.read(buffer.data(), buffer.size());
+      reader.feed(std::string_view(buffer.data(), file.gcount()));
+    }
+  });
+}
+
+Expr ParseCsv(std::string_view text, CsvOptions const& options)
+{
+  return Collect(options, [&](CsvReader& reader) { reader.feed(text); });
+}
+
+} // namespace afct
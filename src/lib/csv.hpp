@@ -0,0 +1,70 @@
+#pragma once
+
+#include "expr.hpp"
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace afct {
+
+struct CsvOptions
+{
+  char delimiter{','};
+  char quote{'"'};
+  // first row names the columns, which must differ, otherwise they are
+  // keyed by index
+  bool header{true};
+  // int, double or bool per column when every field agrees, else string
+  bool infer_types{true};
+  // a table of column lists instead of a list of row tables
+  bool columns{false};
+};
+
+using CsvRow = std::vector<std::string>;
+
+// incremental parser, feed chunks as they arrive; the row passed to the
+// callback is reused, so memory stays bounded by the longest row
+class CsvReader
+{
+public:
+  CsvReader(CsvOptions options, std::function<void(CsvRow const&)> callback);
+
+  void feed(std::string_view chunk);
+  void finish();
+
+private:
+  enum class State
+  {
+    FieldStart,
+    Unquoted,
+    Quoted,
+    QuoteInQuoted
+  };
+
+  void end_field();
+  void end_row();
+
+  CsvOptions _options;
+  std::function<void(CsvRow const&)> _callback;
+  State _state{State::FieldStart};
+  CsvRow _row;
+  size_t _fields{0};
+  bool _pending_cr{false};
+};
+
+void ReadCsv(
+    std::istream& input,
+    CsvOptions const& options,
+    std::function<void(CsvRow const&)> callback,
+    size_t chunk_size = 1 << 16);
+void ReadCsv(
+    std::filesystem::path const& path,
+    CsvOptions const& options,
+    std::function<void(CsvRow const&)> callback);
+Expr ReadCsv(std::filesystem::path const& path, CsvOptions const& options);
+Expr ParseCsv(std::string_view text, CsvOptions const& options);
+
+} // namespace afct
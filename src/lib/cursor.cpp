@@ -0,0 +1,120 @@
+#include "cursor.hpp"
+
+#include "util.hpp"
+
+namespace afct {
+
+ExprCursor::ExprCursor(Expr const& root) : _root(&root)
+{}
+
+ExprCursor::Event ExprCursor::next()
+{
+  if (!_started)
+  {
+    _started = true;
+    return enter(*_root);
+  }
+
+  if (_stack.empty())
+  {
+    _event = Event::End;
+    return _event;
+  }
+
+  auto& frame = _stack.back();
+  auto const& container = *frame.container;
+  if (container.is_list())
+  {
+    auto const& list = container.get_list();
+    if (frame.index < list.size())
+      return enter(list[frame.index++]);
+
+    _stack.pop_back();
+    _current = &container;
+    _event = Event::EndList;
+    return _event;
+  }
+
+  auto const& table = container.get_table();
+  if (frame.value_pending)
+  {
+    frame.value_pending = false;
+    return enter((frame.it++)->second);
+  }
+  else if (frame.it != table.end())
+  {
+    frame.value_pending = true;
+    _current = &frame.it->first;
+    _event = Event::Key;
+    return _event;
+  }
+
+  _stack.pop_back();
+  _current = &container;
+  _event = Event::EndTable;
+  return _event;
+}
+
+Expr const& ExprCursor::expr() const
+{
+  AFCT_CHECK(_current, "Cursor has no current expression");
+  return *_current;
+}
+
+size_t ExprCursor::size() const
+{
+  if (_event == Event::StartList)
+    return _current->get_list().size();
+  else if (_event == Event::StartTable)
+    return _current->get_table().size();
+  return 0;
+}
+
+size_t ExprCursor::depth() const
+{
+  return _stack.size();
+}
+
+void ExprCursor::skip()
+{
+  if (_stack.empty())
+    return;
+
+  auto& frame = _stack.back();
+  if (_event == Event::StartList)
+  {
+    frame.index = frame.container->get_list().size();
+  }
+  else if (_event == Event::StartTable)
+  {
+    frame.it = frame.container->get_table().end();
+    frame.value_pending = false;
+  }
+  else if (_event == Event::Key && frame.value_pending)
+  {
+    frame.it++;
+    frame.value_pending = false;
+  }
+}
+
+ExprCursor::Event ExprCursor::enter(Expr const& expr)
+{
+  _current = &expr;
+  if (expr.is_list())
+  {
+    _stack.push_back({&expr});
+    _event = Event::StartList;
+  }
+  else if (expr.is_table())
+  {
+    _stack.push_back({&expr, 0, expr.get_table().begin()});
+    _event = Event::StartTable;
+  }
+  else
+  {
+    _event = Event::Value;
+  }
+  return _event;
+}
+
+} // namespace afct
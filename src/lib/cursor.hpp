@@ -0,0 +1,86 @@
+#pragma once
+
+#include "expr.hpp"
+#include "visitor.hpp"
+#include <vector>
+
+namespace afct {
+
+// pull-based, iterative walk over an Expr, borrowing from root
+class ExprCursor
+{
+public:
+  enum class Event
+  {
+    Value,
+    StartList,
+    EndList,
+    StartTable,
+    Key,
+    EndTable,
+    End
+  };
+
+  explicit ExprCursor(Expr const& root);
+
+  Event next();
+  // value, key or container of the current event
+  Expr const& expr() const;
+  // element count of the container just started
+  size_t size() const;
+  size_t depth() const;
+  // after a start event, the next event is its end; after a key, the value
+  // is passed over. Calling it again before next does nothing
+  void skip();
+
+private:
+  struct Frame
+  {
+    Expr const* container;
+    size_t index{0};
+    Table::const_iterator it{};
+    bool value_pending{false};
+  };
+
+  Event enter(Expr const& expr);
+
+  std::vector<Frame> _stack;
+  Expr const* _root;
+  Expr const* _current{nullptr};
+  Event _event{Event::End};
+  bool _started{false};
+};
+
+// drives a visitor from the cursor's events without recursing
+template<class V>
+void Visit(ExprCursor& cursor, V& visitor);
+
+} // namespace afct
+
+namespace afct {
+
+template<class V>
+void Visit(ExprCursor& cursor, V& visitor)
+{
+  while (true)
+  {
+    switch (cursor.next())
+    {
+    case ExprCursor::Event::Value: Visit(cursor.expr(), visitor); break;
+    case ExprCursor::Event::StartList: visitor.start_list(cursor.size()); break;
+    case ExprCursor::Event::EndList: visitor.end_list(); break;
+    case ExprCursor::Event::StartTable:
+      visitor.start_table(cursor.size());
+      break;
+    case ExprCursor::Event::Key:
+      visitor.start_key();
+      Visit(cursor.expr(), visitor);
+      visitor.end_key();
+      break;
+    case ExprCursor::Event::EndTable: visitor.end_table(); break;
+    case ExprCursor::Event::End: return;
+    }
+  }
+}
+
+} // namespace afct
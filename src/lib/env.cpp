@@ -1,28 +1,268 @@
 #include "env.hpp"
 
+#include "memory.hpp"
 #include "util.hpp"
+#include <atomic>
 #include <fmt/format.h>
+#include <mutex>
 #include <sstream>
+#include <vector>
 
 namespace afct {
 
+namespace {
+
+// epoch-based reclamation: a reader publishes the epoch it started in, and
+// a retired snapshot is freed only once no reader could still hold it
+std::atomic<uint64_t> global_epoch{1};
+
+struct Reader
+{
+  std::atomic<uint64_t> epoch{0}; // 0 when not reading
+  std::atomic<bool> in_use{true};
+  Reader* next{nullptr};
+};
+
+// records are never freed, only recycled by later threads
+std::atomic<Reader*> readers{nullptr};
+
+Reader* AcquireReader()
+{
+  for (auto reader = readers.load(); reader; reader = reader->next)
+  {
+    bool expected = false;
+    if (reader->in_use.compare_exchange_strong(expected, true))
+      return reader;
+  }
+
+  auto reader = new Reader();
+  reader->next = readers.load();
+  while (!readers.compare_exchange_weak(reader->next, reader))
+  {}
+  return reader;
+}
+
+class ReaderSlot
+{
+public:
+  ReaderSlot() : _reader(AcquireReader())
+  {}
+
+  ~ReaderSlot()
+  {
+    _reader->in_use = false;
+  }
+
+  Reader& get()
+  {
+    return *_reader;
+  }
+
+private:
+  Reader* _reader;
+};
+
+Reader& CurrentReader()
+{
+  thread_local ReaderSlot slot;
+  return slot.get();
+}
+
+// oldest epoch any thread is currently reading in
+uint64_t MinActiveEpoch()
+{
+  auto min = global_epoch.load();
+  for (auto reader = readers.load(); reader; reader = reader->next)
+  {
+    auto epoch = reader->epoch.load();
+    if (epoch != 0 && epoch < min)
+      min = epoch;
+  }
+  return min;
+}
+
+} // namespace
+
+class Env::Snapshots
+{
+public:
+  explicit Snapshots(Bindings bindings = {})
+    : _current(new Bindings(std::move(bindings)))
+  {}
+
+  ~Snapshots()
+  {
+    delete _current.load();
+    for (auto& retired : _retired)
+      delete retired.bindings;
+  }
+
+  Bindings copy() const
+  {
+    auto& reader = CurrentReader();
+    reader.epoch = global_epoch.load();
+    auto result = *_current.load();
+    reader.epoch = 0;
+    return result;
+  }
+
+  std::optional<Expr> find(std::string const& key) const
+  {
+    auto& reader = CurrentReader();
+    reader.epoch = global_epoch.load();
+    std::optional<Expr> result;
+    auto bindings = _current.load();
+    auto it = bindings->find(key);
+    if (it != bindings->end())
+      result = it->second;
+    reader.epoch = 0;
+    return result;
+  }
+
+  void set(std::string key, Expr value)
+  {
+    std::lock_guard lock(_mutex);
+    auto next = new Bindings(*_current.load());
+    (*next)[std::move(key)] = std::move(value);
+    publish(next);
+  }
+
+  void clear()
+  {
+    std::lock_guard lock(_mutex);
+    publish(new Bindings());
+  }
+
+private:
+  struct Retired
+  {
+    Bindings const* bindings;
+    uint64_t epoch;
+  };
+
+  // with the mutex held
+  void publish(Bindings const* next)
+  {
+    auto previous = _current.exchange(next);
+    // readers arriving from now on see an epoch past this one
+    _retired.push_back({previous, ++global_epoch});
+
+    auto min = MinActiveEpoch();
+    std::erase_if(_retired, [min](auto const& retired) {
+      if (retired.epoch > min)
+        return false;
+      delete retired.bindings;
+      return true;
+    });
+  }
+
+  std::atomic<Bindings const*> _current;
+  std::mutex _mutex;
+  std::vector<Retired> _retired;
+};
+
 Env::Env(std::shared_ptr<Env> outer) : _outer(std::move(outer))
 {}
 
+Env::~Env()
+{
+  delete _snapshots.load();
+}
+
+std::shared_ptr<Env> Env::Shared(std::shared_ptr<Env> outer)
+{
+  auto env = std::make_shared<Env>(std::move(outer));
+  env->_snapshots = new Snapshots();
+  return env;
+}
+
+std::shared_ptr<Env> Env::Make(std::shared_ptr<Env> outer)
+{
+  return MakeAccounted<Env>(MemoryKind::Env, 0, std::move(outer));
+}
+
+std::shared_ptr<Env> Env::Frozen(
+    std::vector<std::pair<std::string, Expr>> bindings,
+    std::shared_ptr<Env> outer)
+{
+  auto env = std::make_shared<Env>(std::move(outer));
+  env->_local = Bindings(
+      std::make_move_iterator(bindings.begin()),
+      std::make_move_iterator(bindings.end()));
+  env->_frozen = true;
+  return env;
+}
+
+bool Env::shared() const
+{
+  return _snapshots.load(std::memory_order_acquire) != nullptr;
+}
+
+bool Env::frozen() const
+{
+  return _frozen;
+}
+
 void Env::set(std::string key, Expr value)
 {
-  _local[std::move(key)] = std::move(value);
+  AFCT_CHECK(!_frozen, fmt::format("Cannot set {} in a frozen env", key));
+  if (auto snapshots = _snapshots.load(std::memory_order_acquire))
+    snapshots->set(std::move(key), std::move(value));
+  else
+    _local[std::move(key)] = std::move(value);
 }
 
 std::optional<Expr> Env::find(std::string const& key) const
 {
-  auto it = _local.find(key);
-  if (it != _local.end())
-    return it->second;
+  if (auto snapshots = _snapshots.load(std::memory_order_acquire))
+  {
+    if (auto result = snapshots->find(key))
+      return result;
+  }
+  else
+  {
+    auto it = _local.find(key);
+    if (it != _local.end())
+      return it->second;
+  }
 
   if (!_outer)
     return std::nullopt;
   return _outer->find(key);
 }
 
+void Env::share()
+{
+  if (_frozen || shared())
+    return;
+  // _local stays as it was for any thread that read it before
+  auto snapshots = new Snapshots(_local);
+  Snapshots* expected = nullptr;
+  if (!_snapshots.compare_exchange_strong(expected, snapshots))
+    delete snapshots;
+}
+
+void Env::clear()
+{
+  AFCT_CHECK(!_frozen, "Cannot clear a frozen env");
+  _local.clear();
+  if (auto snapshots = _snapshots.load(std::memory_order_acquire))
+    snapshots->clear();
+}
+
+std::shared_ptr<Env> const& Env::outer() const
+{
+  return _outer;
+}
+
+std::vector<std::pair<std::string, Expr>> Env::bindings() const
+{
+  if (auto snapshots = _snapshots.load(std::memory_order_acquire))
+  {
+    auto local = snapshots->copy();
+    return {local.begin(), local.end()};
+  }
+  return {_local.begin(), _local.end()};
+}
+
 } // namespace afct
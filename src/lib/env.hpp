@@ -2,9 +2,13 @@
 
 #include "expr.hpp"
 #include "util.hpp"
+#include <atomic>
 #include <boost/container/flat_map.hpp>
+#include <memory>
 #include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace afct {
 
@@ -12,12 +16,39 @@ class Env
 {
 public:
   Env(std::shared_ptr<Env> outer = nullptr);
+  ~Env();
+  // for a global env used by many threads at once: lookups never lock and
+  // each set publishes a fresh copy of the bindings, so sets are slow
+  static std::shared_ptr<Env> Shared(std::shared_ptr<Env> outer = nullptr);
+  // charged to the thread's current MemoryAccount, if any
+  static std::shared_ptr<Env> Make(std::shared_ptr<Env> outer = nullptr);
+  // built in one sort and read-only from then on, so any number of threads
+  // can read it without locking
+  static std::shared_ptr<Env> Frozen(
+      std::vector<std::pair<std::string, Expr>> bindings,
+      std::shared_ptr<Env> outer = nullptr);
+
+  bool shared() const;
+  bool frozen() const;
+  // makes a plain env shared in place, before handing it to other threads
+  void share();
   void set(std::string key, Expr value);
   std::optional<Expr> find(std::string const& key) const;
+  // drops local bindings, keeping their storage unless shared
+  void clear();
+  std::shared_ptr<Env> const& outer() const;
+  // local bindings in key order
+  std::vector<std::pair<std::string, Expr>> bindings() const;
 
 private:
-  boost::container::flat_map<std::string, Expr> _local;
+  using Bindings = boost::container::flat_map<std::string, Expr>;
+  class Snapshots;
+
+  Bindings _local;
+  // owned; set at most once, by Shared or share
+  std::atomic<Snapshots*> _snapshots{nullptr};
   std::shared_ptr<Env> _outer;
+  bool _frozen{false};
 };
 
 } // namespace afct
@@ -1,6 +1,9 @@
 #include "eval.hpp"
 
+#include "async.hpp"
+#include "cache.hpp"
 #include "function.hpp"
+#include "lazy.hpp"
 #include "parse.hpp"
 #include "prelude.hpp"
 #include "util.hpp"
@@ -22,6 +25,10 @@ Expr Eval(Expr expr, std::shared_ptr<Env> outer_env)
   {
     auto env = inner_env ? inner_env : outer_env;
 
+    // meters builtins that call back into scripts, which EvalAsync cannot
+    if (auto fuel = Fuel::Current())
+      fuel->charge();
+
     if (expr.is_null() || expr.is_bool() || expr.is_double() || expr.is_int() ||
         expr.is_string())
     {
@@ -90,6 +97,12 @@ Expr Eval(Expr expr, std::shared_ptr<Env> outer_env)
       AFCT_EVAL_CHECK(args.is_list(), "Expected list args in lambda");
       return Expr{Lambda{args.get_list(), body, env}};
     }
+    else if (name == "delay")
+    {
+      AFCT_EVAL_CHECK(list.size() == 2, "Expected 1 arg to delay");
+
+      return NativeFunctionToExpr<Promise>("promise", list[1], env);
+    }
     else if (name == "begin")
     {
       AFCT_EVAL_CHECK(list.size() > 1, "Expected 1+ args to begin");
@@ -116,7 +129,7 @@ Expr Eval(Expr expr, std::shared_ptr<Env> outer_env)
                 lambda.params.size(),
                 n_args));
 
-        auto lambda_env = std::make_shared<Env>(Env(lambda.env));
+        auto lambda_env = Env::Make(lambda.env);
         for (size_t i = 0; i < n_args; i++)
         {
           AFCT_CHECK(
@@ -143,6 +156,126 @@ Expr Eval(Expr expr, std::shared_ptr<Env> outer_env)
   }
 }
 
+AsyncExpr EvalAsync(Expr expr, std::shared_ptr<Env> outer_env, Fuel* fuel)
+{
+  std::shared_ptr<Env> inner_env;
+
+  while (true)
+  {
+    auto env = inner_env ? inner_env : outer_env;
+
+    // one step per turn of the loop covers tail calls and every nested
+    // evaluation, so no loop can run unmetered
+    if (fuel)
+      co_await fuel->tick();
+
+    // nothing but lists and tables can reach an async call
+    if (!expr.is_list() && !expr.is_table())
+    {
+      co_return Eval(expr, env);
+    }
+    else if (expr.is_table())
+    {
+      Table table;
+      for (auto const& pair : expr.get_table())
+      {
+        auto key = co_await EvalAsync(pair.first, env, fuel);
+        table[std::move(key)] = co_await EvalAsync(pair.second, env, fuel);
+      }
+      co_return Expr{table};
+    }
+
+    auto const& list = expr.get_list();
+
+    if (list.empty())
+      co_return expr;
+
+    AFCT_EVAL_CHECK(list.front().is_name(), "Expected name at start of list");
+    auto const& name = list.front().get_name();
+
+    if (name == "quote" || name == "lambda" || name == "delay")
+    {
+      co_return Eval(expr, env);
+    }
+    else if (name == "if")
+    {
+      AFCT_EVAL_CHECK(list.size() == 4, "Expected 3 args to if");
+
+      auto cond = co_await EvalAsync(list[1], env, fuel);
+      expr = cond.truthy() ? list[2] : list[3];
+      continue;
+    }
+    else if (name == "define")
+    {
+      AFCT_EVAL_CHECK(list.size() == 3, "Expected 2 args to define");
+
+      auto const& key = list[1];
+      AFCT_EVAL_CHECK(key.is_name(), "Expected name key to define");
+      auto value = co_await EvalAsync(list[2], env, fuel);
+      env->set(key.get_name(), value);
+      co_return value;
+    }
+    else if (name == "begin")
+    {
+      AFCT_EVAL_CHECK(list.size() > 1, "Expected 1+ args to begin");
+
+      for (size_t i = 1; i < list.size() - 1; i++)
+        co_await EvalAsync(list[i], env, fuel);
+
+      expr = list.back();
+      continue;
+    }
+    else
+    {
+      auto function = co_await EvalAsync(list.front(), env, fuel);
+
+      if (function.is_lambda())
+      {
+        auto const& lambda = function.get_lambda();
+
+        auto n_args = list.size() - 1;
+        AFCT_CHECK(
+            lambda.params.size() == n_args,
+            fmt::format(
+                "Expected {} args to lambda but got {}",
+                lambda.params.size(),
+                n_args));
+
+        auto lambda_env = Env::Make(lambda.env);
+        for (size_t i = 0; i < n_args; i++)
+        {
+          AFCT_CHECK(
+              lambda.params[i].is_name(),
+              fmt::format("Param {} is not a name", lambda.params[i]));
+          lambda_env->set(
+              lambda.params[i].get_name(),
+              co_await EvalAsync(list[i + 1], env, fuel));
+        }
+
+        expr = lambda.body;
+        inner_env = lambda_env;
+        continue;
+      }
+      else if (function.is_builtin())
+      {
+        List args;
+        for (size_t i = 1; i < list.size(); i++)
+          args.push_back(co_await EvalAsync(list[i], env, fuel));
+
+        auto& native = function.get_builtin().function;
+        // without a loop, as under the Scheduler, async functions block
+        auto async = dynamic_cast<IAsyncFunction*>(native.get());
+        if (async && EventLoop::Current())
+          co_return co_await async->call_async(std::move(args), env);
+        Fuel::Scope scope(fuel ? fuel : Fuel::Current());
+        co_return native->call(args, env);
+      }
+
+      AFCT_ERROR(fmt::format("Expected function but got {}", expr));
+    }
+  }
+}
+
 Expr Eval(std::string input, std::shared_ptr<Env> env)
 {
   return Eval(Parse(std::move(input)), env);
@@ -151,12 +284,12 @@ Expr Eval(std::string input, std::shared_ptr<Env> env)
 Expr Eval(std::filesystem::path const& path, std::shared_ptr<Env> env)
 {
   auto file = std::ifstream(path);
-  AFCT_CHECK(file.good(), fmt::format("Failed to open {}", path));
+  AFCT_CHECK(file.good(), fmt::format("Failed to open {}", path.string()));
 
   std::string input(
       (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 
-  return Eval(std::move(input), env);
+  return Eval(ParseCache::Default().parse(std::move(input)), env);
 }
 
 } // namespace afct
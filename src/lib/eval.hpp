@@ -1,5 +1,6 @@
 #pragma once
 
+#include "async.hpp"
 #include "env.hpp"
 #include "expr.hpp"
 #include "prelude.hpp"
@@ -13,5 +14,10 @@ namespace afct {
 Expr Eval(Expr expr, std::shared_ptr<Env> env);
 Expr Eval(std::string input, std::shared_ptr<Env> env);
 Expr Eval(std::filesystem::path const& path, std::shared_ptr<Env> env);
+// suspends at async native calls, so run it on an EventLoop, and when fuel
+// runs out; lambdas called from inside builtins such as map still evaluate
+// synchronously and unmetered
+AsyncExpr EvalAsync(
+    Expr expr, std::shared_ptr<Env> env, Fuel* fuel = nullptr);
 
 } // namespace afct
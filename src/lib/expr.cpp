@@ -1,38 +1,17 @@
 #include "expr.hpp"
 
 #include "function.hpp"
+#include "memory.hpp"
 #include "util.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 #include <functional>
-#include <sstream>
-
-namespace {
-
-template<class T, class F>
-std::ostream& FormatContainer(
-    std::ostream& stream,
-    std::string const& start,
-    std::string const& end,
-    std::string const& sep,
-    T const& container,
-    F formatter)
-{
-  std::ostringstream substream;
-
-  substream << start;
-  for (auto const& item : container)
-  {
-    formatter(substream, item);
-    substream << sep;
-  }
-  substream.seekp(-1, std::ios_base::end);
-  substream << end;
-
-  return stream << substream.str();
-}
-
-} // namespace
+#include <ostream>
+#include <string_view>
+#include <unistd.h>
 
 namespace std {
 
@@ -60,6 +39,151 @@ size_t hash<afct::Expr>::operator()(afct::Expr const& expr) const
 
 namespace afct {
 
+namespace {
+
+void Append(fmt::appender& out, std::string_view text)
+{
+  out = std::copy(text.begin(), text.end(), out);
+}
+
+template<class Flush>
+void Print(fmt::appender& out, Expr const& expr, Flush& flush);
+
+template<class Flush>
+void PrintList(fmt::appender& out, List const& list, Flush& flush)
+{
+  *out++ = '(';
+  for (size_t i = 0; i < list.size(); i++)
+  {
+    if (i > 0)
+      *out++ = ' ';
+    Print(out, list[i], flush);
+  }
+  *out++ = ')';
+}
+
+template<class Flush>
+void Print(fmt::appender& out, Expr const& expr, Flush& flush)
+{
+  switch (expr.get_type())
+  {
+  case Type::Null: Append(out, "null"); break;
+  case Type::Bool: Append(out, expr.get_bool() ? "true" : "false"); break;
+  case Type::Double:
+    // matches the default ostream precision
+    out = fmt::format_to(out, "{:g}", expr.get_double());
+    break;
+  case Type::Int: out = fmt::format_to(out, "{}", expr.get_int()); break;
+  case Type::String:
+    *out++ = '"';
+    Append(out, expr.get_string());
+    *out++ = '"';
+    break;
+  case Type::Name: Append(out, expr.get_name()); break;
+  case Type::Lambda:
+  {
+    auto const& lambda = expr.get_lambda();
+    Append(out, "(lambda ");
+    PrintList(out, lambda.params, flush);
+    *out++ = ' ';
+    Print(out, lambda.body, flush);
+    *out++ = ')';
+    break;
+  }
+  case Type::Builtin: Append(out, expr.get_builtin().name); break;
+  case Type::List:
+  {
+    auto const& list = expr.get_list();
+    if (IsQuote(expr) && list.size() > 1)
+    {
+      *out++ = '\'';
+      Print(out, list[1], flush);
+    }
+    else
+    {
+      PrintList(out, list, flush);
+    }
+    break;
+  }
+  case Type::Table:
+  {
+    Append(out, "#(");
+    bool first = true;
+    for (auto const& pair : expr.get_table())
+    {
+      if (!first)
+        *out++ = ' ';
+      first = false;
+      Print(out, pair.first, flush);
+      *out++ = ' ';
+      Print(out, pair.second, flush);
+    }
+    *out++ = ')';
+    break;
+  }
+  default: Append(out, "?");
+  }
+
+  flush();
+}
+
+template<class Sink>
+void WriteChunked(Expr const& expr, size_t chunk_size, Sink sink)
+{
+  fmt::memory_buffer buffer;
+  auto out = fmt::appender(buffer);
+  auto flush = [&]() {
+    if (buffer.size() >= chunk_size)
+    {
+      sink(buffer.data(), buffer.size());
+      buffer.clear();
+    }
+  };
+  Print(out, expr, flush);
+  if (buffer.size())
+    sink(buffer.data(), buffer.size());
+}
+
+// rough heap footprint of what a node owns when it is made, for accounts
+size_t HeapBytes(std::string const& s)
+{
+  return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+}
+
+size_t HeapBytes(Expr const& expr)
+{
+  return expr.is_string() ? HeapBytes(expr.get_string()) : 0;
+}
+
+size_t ContentBytes(Lambda const& lambda)
+{
+  return lambda.params.capacity() * sizeof(Expr);
+}
+
+size_t ContentBytes(Builtin const& builtin)
+{
+  return HeapBytes(builtin.name);
+}
+
+size_t ContentBytes(List const& list)
+{
+  auto bytes = list.capacity() * sizeof(Expr);
+  for (auto const& e : list)
+    bytes += HeapBytes(e);
+  return bytes;
+}
+
+size_t ContentBytes(Table const& table)
+{
+  auto bytes = table.bucket_count() * sizeof(void*);
+  for (auto const& [key, value] : table)
+    bytes += 2 * sizeof(void*) + sizeof(std::pair<Expr const, Expr>) +
+        HeapBytes(key) + HeapBytes(value);
+  return bytes;
+}
+
+} // namespace
+
 Expr::Expr() : _type(Type::Null)
 {}
 
@@ -85,19 +209,39 @@ Expr::Expr(Name n) : _type(Type::Name), _value(std::move(n.n))
 {}
 
 Expr::Expr(Lambda l)
-  : _type(Type::Lambda), _value(std::make_shared<Lambda>(std::move(l)))
+  : _type(Type::Lambda)
+  , _value(MakeAccounted<Lambda>(
+        MemoryKind::Lambda, [&] { return ContentBytes(l); }, std::move(l)))
 {}
 
 Expr::Expr(Builtin b)
-  : _type(Type::Builtin), _value(std::make_shared<Builtin>(std::move(b)))
+  : _type(Type::Builtin)
+  , _value(MakeAccounted<Builtin>(
+        MemoryKind::Builtin, [&] { return ContentBytes(b); }, std::move(b)))
 {}
 
 Expr::Expr(List l)
-  : _type(Type::List), _value(std::make_shared<List>(std::move(l)))
+  : _type(Type::List)
+  , _value(MakeAccounted<List>(
+        MemoryKind::List, [&] { return ContentBytes(l); }, std::move(l)))
 {}
 
 Expr::Expr(Table t)
-  : _type(Type::Table), _value(std::make_shared<Table>(std::move(t)))
+  : _type(Type::Table)
+  , _value(MakeAccounted<Table>(
+        MemoryKind::Table, [&] { return ContentBytes(t); }, std::move(t)))
+{}
+
+Expr::Expr(List l, std::pmr::memory_resource* resource)
+  : _type(Type::List)
+  , _value(std::allocate_shared<List>(
+        std::pmr::polymorphic_allocator<List>(resource), std::move(l)))
+{}
+
+Expr::Expr(Table t, std::pmr::memory_resource* resource)
+  : _type(Type::Table)
+  , _value(std::allocate_shared<Table>(
+        std::pmr::polymorphic_allocator<Table>(resource), std::move(t)))
 {}
 
 bool Expr::is_null() const
@@ -332,65 +476,39 @@ bool operator!=(Expr const& lhs, Expr const& rhs)
 
 std::ostream& operator<<(std::ostream& stream, Expr const& expr)
 {
-  auto type = expr.get_type();
-
-  if (type == Type::Null)
-    return stream << "null";
-  else if (type == Type::Bool)
-    return stream << (expr.get_bool() ? "true" : "false");
-  else if (type == Type::Double)
-    return stream << expr.get_double();
-  else if (type == Type::Int)
-    return stream << expr.get_int();
-  else if (type == Type::String)
-    return stream << '"' << expr.get_string() << '"';
-  else if (type == Type::Name)
-    return stream << expr.get_name();
-  else if (type == Type::Lambda)
-    return stream << expr.get_lambda();
-  else if (type == Type::Builtin)
-    return stream << expr.get_builtin();
-  else if (type == Type::List)
-  {
-    if (IsQuote(expr))
-    {
-      return stream << "'" << Unquote(expr);
-    }
-    else
+  WriteChunked(expr, 1 << 16, [&](char const* data, size_t size) {
+    stream.write(data, size);
+  });
+  return stream;
+}
+
+fmt::appender Format(fmt::appender out, Expr const& expr)
+{
+  auto flush = []() {};
+  Print(out, expr, flush);
+  return out;
+}
+
+void Format(fmt::memory_buffer& buffer, Expr const& expr)
+{
+  Format(fmt::appender(buffer), expr);
+}
+
+void Write(int fd, Expr const& expr, size_t chunk_size)
+{
+  WriteChunked(expr, chunk_size, [&](char const* data, size_t size) {
+    while (size)
     {
-      auto const& list = expr.get_list();
-
-      if (list.empty())
-        return stream << "()";
-
-      return FormatContainer(
-          stream,
-          "(",
-          ")",
-          " ",
-          list,
-          [](std::ostream& stream, auto const& element) { stream << element; });
+      auto written = ::write(fd, data, size);
+      if (written < 0 && errno == EINTR)
+        continue;
+      AFCT_CHECK(
+          written > 0,
+          fmt::format("Failed to write to fd {}: {}", fd, strerror(errno)));
+      data += written;
+      size -= written;
     }
-  }
-  else if (type == Type::Table)
-  {
-    auto const& table = expr.get_table();
-
-    if (table.empty())
-      return stream << "#()";
-
-    return FormatContainer(
-        stream,
-        "#(",
-        ")",
-        " ",
-        table,
-        [](std::ostream& stream, auto const& pair) {
-          stream << pair.first << " " << pair.second;
-        });
-  }
-  else
-    return stream << "?";
+  });
 }
 
 bool IsQuote(Expr const& expr)
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <fmt/format.h>
 #include <memory>
+#include <memory_resource>
 #include <string>
 #include <unordered_map>
 #include <variant>
@@ -70,6 +72,10 @@ public:
   explicit Expr(Builtin b);
   explicit Expr(List l);
   explicit Expr(Table t);
+  // only the node, not the elements, comes from resource, which must
+  // outlive the Expr
+  Expr(List l, std::pmr::memory_resource* resource);
+  Expr(Table t, std::pmr::memory_resource* resource);
   bool is_null() const;
   bool is_bool() const;
   bool is_double() const;
@@ -122,7 +128,28 @@ bool operator==(Expr const& lhs, Expr const& rhs);
 bool operator!=(Expr const& lhs, Expr const& rhs);
 std::ostream& operator<<(std::ostream& stream, Expr const& expr);
 
+// single linear pass into one buffer, no intermediate strings
+fmt::appender Format(fmt::appender out, Expr const& expr);
+void Format(fmt::memory_buffer& buffer, Expr const& expr);
+// flushes to the descriptor whenever chunk_size bytes are buffered
+void Write(int fd, Expr const& expr, size_t chunk_size = 1 << 16);
+
 bool IsQuote(Expr const& expr);
 Expr Unquote(Expr const& expr);
 
 } // namespace afct
+
+template<>
+struct fmt::formatter<afct::Expr>
+{
+  constexpr auto parse(format_parse_context& ctx) -> decltype(ctx.begin())
+  {
+    return ctx.begin();
+  }
+
+  auto format(afct::Expr const& expr, format_context& ctx) const
+      -> decltype(ctx.out())
+  {
+    return afct::Format(ctx.out(), expr);
+  }
+};
@@ -69,7 +69,7 @@ Expr Call(Expr const& expr, List& args, std::shared_ptr<Env> env)
           lambda.params.size(),
           args.size()));
 
-  auto lambda_env = std::make_shared<Env>(env);
+  auto lambda_env = Env::Make(env);
   for (size_t i = 0; i < lambda.params.size(); i++)
   {
     AFCT_CHECK(
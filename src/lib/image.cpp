@@ -0,0 +1,449 @@
+#include "image.hpp"
+
+#include "util.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace afct {
+
+namespace {
+
+// header is magic, version, root offset; every node starts with its type
+// word and is 8-byte aligned
+constexpr uint64_t kMagic = 0x49474d49'54434641; // "AFCTIMGI"
+constexpr uint64_t kVersion = 1;
+constexpr uint64_t kHeaderSize = 24;
+
+// stable across processes, unlike std::hash
+uint64_t HashBytes(uint64_t seed, std::string_view bytes)
+{
+  auto hash = 14695981039346656037ull ^ seed;
+  for (auto c : bytes)
+  {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+uint64_t HashWord(Type type, uint64_t word)
+{
+  char bytes[8];
+  for (size_t i = 0; i < 8; i++)
+    bytes[i] = static_cast<char>(word >> (8 * i));
+  return HashBytes(static_cast<uint64_t>(type), std::string_view(bytes, 8));
+}
+
+uint64_t DoubleBits(double d)
+{
+  uint64_t bits;
+  std::memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+uint64_t HashKey(Expr const& key)
+{
+  switch (key.get_type())
+  {
+  case Type::Bool: return HashWord(Type::Bool, key.get_bool());
+  case Type::Double:
+    return HashWord(Type::Double, DoubleBits(key.get_double()));
+  case Type::Int: return HashWord(Type::Int, key.get_int());
+  case Type::String:
+    return HashBytes(static_cast<uint64_t>(Type::String), key.get_string());
+  case Type::Name:
+    return HashBytes(static_cast<uint64_t>(Type::Name), key.get_name());
+  default: AFCT_ERROR(fmt::format("Key {} not hashable in image", key));
+  }
+}
+
+class Writer
+{
+public:
+  Writer()
+  {
+    for (size_t i = 0; i < kHeaderSize / 8; i++)
+      put(0);
+  }
+
+  std::string finish(uint64_t root)
+  {
+    set(0, kMagic);
+    set(8, kVersion);
+    set(16, root);
+    return std::move(_out);
+  }
+
+  uint64_t write(Expr const& expr)
+  {
+    auto type = expr.get_type();
+    switch (type)
+    {
+    case Type::Null: return node(type);
+    case Type::Bool: return node(type, expr.get_bool());
+    case Type::Double: return node(type, DoubleBits(expr.get_double()));
+    case Type::Int: return node(type, expr.get_int());
+    case Type::String: return text(type, expr.get_string());
+    case Type::Name: return text(type, expr.get_name());
+    case Type::List:
+    {
+      std::vector<uint64_t> offsets;
+      for (auto const& element : expr.get_list())
+        offsets.push_back(write(element));
+
+      auto offset = node(type, offsets.size());
+      for (auto element : offsets)
+        put(element);
+      return offset;
+    }
+    case Type::Table:
+    {
+      struct Entry
+      {
+        uint64_t hash, key, value;
+      };
+      std::vector<Entry> entries;
+      for (auto const& pair : expr.get_table())
+        entries.push_back(
+            {HashKey(pair.first), write(pair.first), write(pair.second)});
+      std::sort(entries.begin(), entries.end(), [](auto& lhs, auto& rhs) {
+        return lhs.hash < rhs.hash;
+      });
+
+      auto offset = node(type, entries.size());
+      for (auto const& entry : entries)
+      {
+        put(entry.hash);
+        put(entry.key);
+        put(entry.value);
+      }
+      return offset;
+    }
+    default: AFCT_ERROR(fmt::format("{} not storable in image", expr));
+    }
+  }
+
+private:
+  uint64_t node(Type type)
+  {
+    auto offset = _out.size();
+    put(static_cast<uint64_t>(type));
+    return offset;
+  }
+
+  uint64_t node(Type type, uint64_t payload)
+  {
+    auto offset = node(type);
+    put(payload);
+    return offset;
+  }
+
+  uint64_t text(Type type, std::string const& value)
+  {
+    auto offset = node(type, value.size());
+    _out.append(value);
+    _out.resize((_out.size() + 7) / 8 * 8, '\0');
+    return offset;
+  }
+
+  void put(uint64_t word)
+  {
+    for (size_t i = 0; i < 8; i++)
+      _out.push_back(static_cast<char>(word >> (8 * i)));
+  }
+
+  void set(size_t offset, uint64_t word)
+  {
+    for (size_t i = 0; i < 8; i++)
+      _out[offset + i] = static_cast<char>(word >> (8 * i));
+  }
+
+  std::string _out;
+};
+
+} // namespace
+
+ImageView::ImageView(Image const* image, uint64_t offset)
+  : _image(image), _offset(offset)
+{}
+
+Type ImageView::get_type() const
+{
+  auto type = word(0);
+  AFCT_CHECK(
+      type <= static_cast<uint64_t>(Type::Table) &&
+          type != static_cast<uint64_t>(Type::Lambda) &&
+          type != static_cast<uint64_t>(Type::Builtin),
+      fmt::format("Bad node type {} in image", type));
+  return static_cast<Type>(type);
+}
+
+bool ImageView::is_list() const
+{
+  return get_type() == Type::List;
+}
+
+bool ImageView::is_table() const
+{
+  return get_type() == Type::Table;
+}
+
+bool ImageView::get_bool() const
+{
+  check(Type::Bool);
+  return word(1) != 0;
+}
+
+double ImageView::get_double() const
+{
+  check(Type::Double);
+  auto bits = word(1);
+  double d;
+  std::memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+int64_t ImageView::get_int() const
+{
+  check(Type::Int);
+  return static_cast<int64_t>(word(1));
+}
+
+std::string_view ImageView::get_string() const
+{
+  check(Type::String);
+  return _image->bytes(_offset + 16, word(1));
+}
+
+std::string_view ImageView::get_name() const
+{
+  check(Type::Name);
+  return _image->bytes(_offset + 16, word(1));
+}
+
+size_t ImageView::size() const
+{
+  auto type = get_type();
+  AFCT_CHECK(
+      type == Type::List || type == Type::Table,
+      "Image node is not a list or table");
+  return word(1);
+}
+
+ImageView ImageView::at(size_t i) const
+{
+  check(Type::List);
+  AFCT_CHECK(i < size(), fmt::format("Index {} out of range in image", i));
+  return child(2 + i);
+}
+
+ImageView ImageView::key_at(size_t i) const
+{
+  check(Type::Table);
+  AFCT_CHECK(i < size(), fmt::format("Index {} out of range in image", i));
+  return child(2 + 3 * i + 1);
+}
+
+ImageView ImageView::value_at(size_t i) const
+{
+  check(Type::Table);
+  AFCT_CHECK(i < size(), fmt::format("Index {} out of range in image", i));
+  return child(2 + 3 * i + 2);
+}
+
+std::optional<ImageView> ImageView::find(Expr const& key) const
+{
+  check(Type::Table);
+  auto hash = HashKey(key);
+
+  size_t low = 0;
+  size_t high = size();
+  while (low < high)
+  {
+    auto mid = low + (high - low) / 2;
+    if (word(2 + 3 * mid) < hash)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  for (auto i = low; i < size() && word(2 + 3 * i) == hash; i++)
+  {
+    if (key_at(i) == key)
+      return value_at(i);
+  }
+  return std::nullopt;
+}
+
+bool ImageView::operator==(Expr const& expr) const
+{
+  auto type = get_type();
+  if (type != expr.get_type())
+    return false;
+
+  switch (type)
+  {
+  case Type::Null: return true;
+  case Type::Bool: return get_bool() == expr.get_bool();
+  case Type::Double: return get_double() == expr.get_double();
+  case Type::Int: return get_int() == expr.get_int();
+  case Type::String: return get_string() == expr.get_string();
+  case Type::Name: return get_name() == expr.get_name();
+  default: return to_expr() == expr;
+  }
+}
+
+Expr ImageView::to_expr() const
+{
+  switch (get_type())
+  {
+  case Type::Null: return Expr{};
+  case Type::Bool: return Expr{get_bool()};
+  case Type::Double: return Expr{get_double()};
+  case Type::Int: return Expr{get_int()};
+  case Type::String: return Expr{String{std::string(get_string())}};
+  case Type::Name: return Expr{Name{std::string(get_name())}};
+  case Type::List:
+  {
+    List list;
+    list.reserve(size());
+    for (size_t i = 0; i < size(); i++)
+      list.push_back(at(i).to_expr());
+    return Expr{std::move(list)};
+  }
+  case Type::Table:
+  {
+    Table table;
+    table.reserve(size());
+    for (size_t i = 0; i < size(); i++)
+      table[key_at(i).to_expr()] = value_at(i).to_expr();
+    return Expr{std::move(table)};
+  }
+  default: AFCT_ERROR("Bad node type in image");
+  }
+}
+
+uint64_t ImageView::word(size_t i) const
+{
+  return _image->word(_offset + 8 * i);
+}
+
+ImageView ImageView::child(size_t i) const
+{
+  // children are written before their parent, so pointing at or past it
+  // would only come from a corrupt image, and could loop forever
+  auto offset = word(i);
+  AFCT_CHECK(offset < _offset, "Bad child offset in image");
+  return ImageView(_image, offset);
+}
+
+void ImageView::check(Type type) const
+{
+  AFCT_CHECK(
+      get_type() == type,
+      fmt::format("Image node type {} is not {}", word(0), int(type)));
+}
+
+std::shared_ptr<Image const> Image::Open(std::filesystem::path const& path)
+{
+  auto fd = ::open(path.c_str(), O_RDONLY);
+  AFCT_CHECK(fd >= 0, fmt::format("Failed to open {}", path.string()));
+
+  struct stat status;
+  if (::fstat(fd, &status) != 0)
+  {
+    ::close(fd);
+    AFCT_ERROR(fmt::format("Failed to stat {}", path.string()));
+  }
+
+  std::shared_ptr<Image> image(new Image());
+  image->_size = status.st_size;
+  if (image->_size)
+  {
+    image->_mapping =
+        ::mmap(nullptr, image->_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  ::close(fd);
+  AFCT_CHECK(
+      image->_mapping != MAP_FAILED,
+      fmt::format("Failed to map {}", path.string()));
+  image->_data = static_cast<char const*>(image->_mapping);
+  image->validate();
+  return image;
+}
+
+std::shared_ptr<Image const> Image::FromString(std::string data)
+{
+  std::shared_ptr<Image> image(new Image());
+  image->_buffer = std::move(data);
+  image->_data = image->_buffer.data();
+  image->_size = image->_buffer.size();
+  image->validate();
+  return image;
+}
+
+Image::~Image()
+{
+  if (_mapping && _mapping != MAP_FAILED)
+    ::munmap(_mapping, _size);
+}
+
+ImageView Image::root() const
+{
+  return ImageView(this, word(16));
+}
+
+uint64_t Image::word(uint64_t offset) const
+{
+  AFCT_CHECK(
+      offset % 8 == 0 && offset + 8 <= _size && offset + 8 > offset,
+      "Offset out of range in image");
+  uint64_t result = 0;
+  for (size_t i = 0; i < 8; i++)
+    result |= static_cast<uint64_t>(static_cast<uint8_t>(_data[offset + i]))
+        << (8 * i);
+  return result;
+}
+
+std::string_view Image::bytes(uint64_t offset, uint64_t size) const
+{
+  AFCT_CHECK(
+      offset <= _size && size <= _size - offset,
+      "Offset out of range in image");
+  return std::string_view(_data + offset, size);
+}
+
+void Image::validate()
+{
+  AFCT_CHECK(
+      _size >= kHeaderSize && word(0) == kMagic, "Not an expression image");
+  AFCT_CHECK(
+      word(8) == kVersion,
+      fmt::format("Unsupported image version {}", word(8)));
+  root().get_type();
+}
+
+std::string EncodeImage(Expr const& expr)
+{
+  Writer writer;
+  auto root = writer.write(expr);
+  return writer.finish(root);
+}
+
+void WriteImage(Expr const& expr, std::filesystem::path const& path)
+{
+  auto data = EncodeImage(expr);
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  AFCT_CHECK(file.good(), fmt::format("Failed to open {}", path.string()));
+  file.write(data.data(), data.size());
+  AFCT_CHECK(file.good(), fmt::format("Failed to write {}", path.string()));
+}
+
+} // namespace afct
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "expr.hpp"
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace afct {
+
+class Image;
+
+// lazy, read-only view of one node in an image, borrowing from the image
+class ImageView
+{
+public:
+  ImageView(Image const* image, uint64_t offset);
+
+  Type get_type() const;
+  bool is_list() const;
+  bool is_table() const;
+  bool get_bool() const;
+  double get_double() const;
+  int64_t get_int() const;
+  std::string_view get_string() const;
+  std::string_view get_name() const;
+  // element count of a list or table
+  size_t size() const;
+  ImageView at(size_t i) const;
+  ImageView key_at(size_t i) const;
+  ImageView value_at(size_t i) const;
+  // O(log n) through the table's sorted hash directory
+  std::optional<ImageView> find(Expr const& key) const;
+  bool operator==(Expr const& expr) const;
+  // decodes the subtree below this node
+  Expr to_expr() const;
+
+private:
+  uint64_t word(size_t i) const;
+  // node at the offset in word i
+  ImageView child(size_t i) const;
+  void check(Type type) const;
+
+  Image const* _image;
+  uint64_t _offset;
+};
+
+// on-disk Expr where lists store offset arrays and tables store key
+// directories sorted by hash, readable in place from a mapping
+class Image
+{
+public:
+  static std::shared_ptr<Image const> Open(std::filesystem::path const& path);
+  static std::shared_ptr<Image const> FromString(std::string data);
+  Image(Image const&) = delete;
+  Image& operator=(Image const&) = delete;
+  ~Image();
+
+  ImageView root() const;
+  uint64_t word(uint64_t offset) const;
+  std::string_view bytes(uint64_t offset, uint64_t size) const;
+
+private:
+  Image() = default;
+  void validate();
+
+  std::string _buffer;
+  void* _mapping{nullptr};
+  char const* _data{nullptr};
+  size_t _size{0};
+};
+
+std::string EncodeImage(Expr const& expr);
+void WriteImage(Expr const& expr, std::filesystem::path const& path);
+
+} // namespace afct
@@ -0,0 +1,449 @@
+#include "json.hpp"
+
+#include "cursor.hpp"
+#include "util.hpp"
+#include <charconv>
+#include <cmath>
+#include <fmt/format.h>
+
+namespace afct {
+
+namespace {
+
+class JsonParser
+{
+public:
+  JsonParser(std::string_view text, Builder& builder)
+    : _text(text), _builder(builder)
+  {}
+
+  void run()
+  {
+    value();
+    while (!_stack.empty())
+    {
+      auto& frame = _stack.back();
+      space();
+      auto close = frame.object ? '}' : ']';
+      if (peek() == close)
+      {
+        _pos++;
+        if (frame.object)
+          _builder.end_table();
+        else
+          _builder.end_list();
+        _stack.pop_back();
+        continue;
+      }
+
+      if (frame.count++ > 0)
+      {
+        expect(',');
+        space();
+      }
+
+      if (frame.object)
+      {
+        expect('"');
+        _builder.string_key(string());
+        space();
+        expect(':');
+      }
+      value();
+    }
+
+    space();
+    AFCT_CHECK(_pos == _text.size(), error("Unexpected characters"));
+  }
+
+private:
+  struct Frame
+  {
+    bool object;
+    size_t count{0};
+  };
+
+  void value()
+  {
+    space();
+    auto c = peek();
+    if (c == '{')
+    {
+      _pos++;
+      _builder.start_table();
+      _stack.push_back({true});
+    }
+    else if (c == '[')
+    {
+      _pos++;
+      _builder.start_list();
+      _stack.push_back({false});
+    }
+    else if (c == '"')
+    {
+      _pos++;
+      _builder.string_value(string());
+    }
+    else if (c == 't')
+    {
+      literal("true");
+      _builder.bool_value(true);
+    }
+    else if (c == 'f')
+    {
+      literal("false");
+      _builder.bool_value(false);
+    }
+    else if (c == 'n')
+    {
+      literal("null");
+      _builder.null_value();
+    }
+    else if (c == '-' || (c >= '0' && c <= '9'))
+    {
+      number();
+    }
+    else
+    {
+      AFCT_ERROR(error("Expected value"));
+    }
+  }
+
+  void number()
+  {
+    auto start = _pos;
+    bool integral = true;
+    if (peek() == '-')
+      _pos++;
+    auto integer = _pos;
+    AFCT_CHECK(digits() > 0, error("Expected digit"));
+    AFCT_CHECK(
+        _text[integer] != '0' || _pos == integer + 1,
+        error("Leading zero in number"));
+    if (peek() == '.')
+    {
+      integral = false;
+      _pos++;
+      AFCT_CHECK(digits() > 0, error("Expected digit after ."));
+    }
+    if (peek() == 'e' || peek() == 'E')
+    {
+      integral = false;
+      _pos++;
+      if (peek() == '+' || peek() == '-')
+        _pos++;
+      AFCT_CHECK(digits() > 0, error("Expected exponent"));
+    }
+
+    auto first = _text.data() + start;
+    auto last = _text.data() + _pos;
+    if (integral)
+    {
+      int64_t i;
+      auto [end, ec] = std::from_chars(first, last, i);
+      if (ec == std::errc() && end == last)
+      {
+        _builder.int_value(i);
+        return;
+      }
+    }
+
+    double d;
+    auto [end, ec] = std::from_chars(first, last, d);
+    AFCT_CHECK(ec == std::errc() && end == last, error("Bad number"));
+    _builder.double_value(d);
+  }
+
+  size_t digits()
+  {
+    auto start = _pos;
+    while (_pos < _text.size() && _text[_pos] >= '0' && _text[_pos] <= '9')
+      _pos++;
+    return _pos - start;
+  }
+
+  // after the opening quote
+  std::string string()
+  {
+    std::string result;
+    while (true)
+    {
+      auto start = _pos;
+      while (_pos < _text.size() && _text[_pos] != '"' && _text[_pos] != '\\' &&
+             static_cast<unsigned char>(_text[_pos]) >= 0x20)
+        _pos++;
+      result.append(_text.substr(start, _pos - start));
+
+      auto c = peek();
+      _pos++;
+      if (c == '"')
+        return result;
+      AFCT_CHECK(c == '\\', error("Unterminated string"));
+
+      c = peek();
+      _pos++;
+      switch (c)
+      {
+      case '"': result += '"'; break;
+      case '\\': result += '\\'; break;
+      case '/': result += '/'; break;
+      case 'b': result += '\b'; break;
+      case 'f': result += '\f'; break;
+      case 'n': result += '\n'; break;
+      case 'r': result += '\r'; break;
+      case 't': result += '\t'; break;
+      case 'u': unicode(result); break;
+      default: AFCT_ERROR(error("Bad escape"));
+      }
+    }
+  }
+
+  void unicode(std::string& result)
+  {
+    uint32_t code = hex();
+    if (code >= 0xd800 && code <= 0xdbff)
+    {
+      AFCT_CHECK(
+          _text.substr(_pos, 2) == "\\u", error("Expected low surrogate"));
+      _pos += 2;
+      auto low = hex();
+      AFCT_CHECK(low >= 0xdc00 && low <= 0xdfff, error("Bad low surrogate"));
+      code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+    }
+    else
+    {
+      AFCT_CHECK(code < 0xdc00 || code > 0xdfff, error("Lone surrogate"));
+    }
+
+    if (code < 0x80)
+    {
+      result += static_cast<char>(code);
+    }
+    else if (code < 0x800)
+    {
+      result += static_cast<char>(0xc0 | (code >> 6));
+      result += static_cast<char>(0x80 | (code & 0x3f));
+    }
+    else if (code < 0x10000)
+    {
+      result += static_cast<char>(0xe0 | (code >> 12));
+      result += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      result += static_cast<char>(0x80 | (code & 0x3f));
+    }
+    else
+    {
+      result += static_cast<char>(0xf0 | (code >> 18));
+      result += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+      result += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      result += static_cast<char>(0x80 | (code & 0x3f));
+    }
+  }
+
+  uint32_t hex()
+  {
+    AFCT_CHECK(_pos + 4 <= _text.size(), error("Truncated \\u escape"));
+    uint32_t code;
+    auto first = _text.data() + _pos;
+    auto [end, ec] = std::from_chars(first, first + 4, code, 16);
+    AFCT_CHECK(ec == std::errc() && end == first + 4, error("Bad \\u escape"));
+    _pos += 4;
+    return code;
+  }
+
+  void literal(std::string_view word)
+  {
+    AFCT_CHECK(_text.substr(_pos, word.size()) == word, error("Bad literal"));
+    _pos += word.size();
+  }
+
+  void space()
+  {
+    while (_pos < _text.size() &&
+           (_text[_pos] == ' ' || _text[_pos] == '\n' || _text[_pos] == '\r' ||
+            _text[_pos] == '\t'))
+      _pos++;
+  }
+
+  char peek() const
+  {
+    return _pos < _text.size() ? _text[_pos] : '\0';
+  }
+
+  void expect(char c)
+  {
+    AFCT_CHECK(peek() == c, error(fmt::format("Expected '{}'", c)));
+    _pos++;
+  }
+
+  std::string error(std::string const& message) const
+  {
+    return fmt::format("{} at offset {} in JSON", message, _pos);
+  }
+
+  std::string_view _text;
+  Builder& _builder;
+  size_t _pos{0};
+  std::vector<Frame> _stack;
+};
+
+} // namespace
+
+void ParseJson(std::string_view text, Builder& builder)
+{
+  JsonParser(text, builder).run();
+}
+
+Expr ParseJson(std::string_view text)
+{
+  Builder builder;
+  ParseJson(text, builder);
+  return builder.take_expr();
+}
+
+JsonWriter::JsonWriter(std::string& out) : _out(out)
+{}
+
+void JsonWriter::null_value()
+{
+  scalar("null");
+}
+
+void JsonWriter::bool_value(bool value)
+{
+  scalar(value ? "true" : "false");
+}
+
+void JsonWriter::double_value(double value)
+{
+  if (!std::isfinite(value))
+    return scalar("null");
+
+  // shortest round-trip form, kept distinguishable from an int
+  auto text = fmt::format("{}", value);
+  if (text.find_first_of(".e") == std::string::npos)
+    text += ".0";
+  scalar(text);
+}
+
+void JsonWriter::int_value(int64_t value)
+{
+  scalar(fmt::format("{}", value));
+}
+
+void JsonWriter::string_value(std::string const& value)
+{
+  separate();
+  quoted(value);
+}
+
+void JsonWriter::name_value(std::string const& value)
+{
+  string_value(value);
+}
+
+void JsonWriter::lambda_value(Lambda const&)
+{
+  AFCT_ERROR("Lambda not representable in JSON");
+}
+
+void JsonWriter::builtin_value(Builtin const&)
+{
+  AFCT_ERROR("Builtin not representable in JSON");
+}
+
+void JsonWriter::start_list(size_t)
+{
+  separate();
+  _out += '[';
+  _first.push_back(true);
+}
+
+void JsonWriter::end_list()
+{
+  _out += ']';
+  _first.pop_back();
+}
+
+void JsonWriter::start_table(size_t)
+{
+  separate();
+  _out += '{';
+  _first.push_back(true);
+}
+
+void JsonWriter::start_key()
+{
+  _in_key = true;
+}
+
+void JsonWriter::end_key()
+{
+  _in_key = false;
+  _out += ':';
+  _after_key = true;
+}
+
+void JsonWriter::end_table()
+{
+  _out += '}';
+  _first.pop_back();
+}
+
+void JsonWriter::separate()
+{
+  if (_after_key)
+  {
+    _after_key = false;
+    return;
+  }
+  if (!_first.empty())
+  {
+    if (!_first.back())
+      _out += ',';
+    _first.back() = false;
+  }
+}
+
+void JsonWriter::scalar(std::string_view text)
+{
+  separate();
+  if (_in_key)
+    quoted(text);
+  else
+    _out += text;
+}
+
+void JsonWriter::quoted(std::string_view text)
+{
+  _out += '"';
+  for (auto c : text)
+  {
+    switch (c)
+    {
+    case '"': _out += "\\\""; break;
+    case '\\': _out += "\\\\"; break;
+    case '\n': _out += "\\n"; break;
+    case '\r': _out += "\\r"; break;
+    case '\t': _out += "\\t"; break;
+    case '\b': _out += "\\b"; break;
+    case '\f': _out += "\\f"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20)
+        fmt::format_to(std::back_inserter(_out), "\\u{:04x}", int(c));
+      else
+        _out += c;
+    }
+  }
+  _out += '"';
+}
+
+std::string ToJson(Expr const& expr)
+{
+  std::string out;
+  JsonWriter writer(out);
+  ExprCursor cursor(expr);
+  Visit(cursor, writer);
+  return out;
+}
+
+} // namespace afct
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "builder.hpp"
+#include "expr.hpp"
+#include "visitor.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace afct {
+
+// objects become tables with string keys, arrays lists, and numbers ints
+// when they have no fraction or exponent and fit, doubles otherwise
+void ParseJson(std::string_view text, Builder& builder);
+Expr ParseJson(std::string_view text);
+
+// non-string table keys are written as strings of their text form
+class JsonWriter final : public IVisitor
+{
+public:
+  explicit JsonWriter(std::string& out);
+
+  void null_value() override;
+  void bool_value(bool value) override;
+  void double_value(double value) override;
+  void int_value(int64_t value) override;
+  void string_value(std::string const& value) override;
+  void name_value(std::string const& value) override;
+  void lambda_value(Lambda const& value) override;
+  void builtin_value(Builtin const& value) override;
+  void start_list(size_t size) override;
+  void end_list() override;
+  void start_table(size_t size) override;
+  void start_key() override;
+  void end_key() override;
+  void end_table() override;
+
+private:
+  void separate();
+  void scalar(std::string_view text);
+  void quoted(std::string_view text);
+
+  std::string& _out;
+  // whether the container at each level has had an item yet
+  std::vector<bool> _first;
+  bool _in_key{false};
+  bool _after_key{false};
+};
+
+std::string ToJson(Expr const& expr);
+
+} // namespace afct
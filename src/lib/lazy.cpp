@@ -0,0 +1,392 @@
+#include "lazy.hpp"
+
+#include "eval.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <fmt/format.h>
+
+namespace afct {
+
+namespace {
+
+class RangeIterator final : public SeqIterator
+{
+public:
+  RangeIterator(int64_t start, std::optional<int64_t> end, int64_t step)
+    : _current(start), _end(end), _step(step)
+  {}
+
+  void next(List& chunk, size_t max) final
+  {
+    chunk.clear();
+    for (size_t i = 0; i < max && !_done; i++)
+    {
+      if (_end && (_step > 0 ? _current >= *_end : _current <= *_end))
+        return;
+      chunk.emplace_back(_current);
+      // the next value would not fit, so the range ends here
+      _done = __builtin_add_overflow(_current, _step, &_current);
+    }
+  }
+
+private:
+  bool _done{false};
+  int64_t _current;
+  std::optional<int64_t> _end;
+  int64_t _step;
+};
+
+class RangeSeq final : public Seq
+{
+public:
+  RangeSeq(int64_t start, std::optional<int64_t> end, int64_t step)
+    : _start(start), _end(end), _step(step)
+  {}
+
+  std::unique_ptr<SeqIterator> iter() const final
+  {
+    return std::make_unique<RangeIterator>(_start, _end, _step);
+  }
+
+private:
+  int64_t _start;
+  std::optional<int64_t> _end;
+  int64_t _step;
+};
+
+class IterateIterator final : public SeqIterator
+{
+public:
+  IterateIterator(Expr function, Expr initial, std::shared_ptr<Env> env)
+    : _function(std::move(function)), _env(std::move(env)), _arg{initial}
+  {}
+
+  void next(List& chunk, size_t max) final
+  {
+    chunk.clear();
+    for (size_t i = 0; i < max; i++)
+    {
+      // only apply the function once the previous element was consumed
+      if (_started)
+        _arg[0] = Call(_function, _arg, _env);
+      _started = true;
+      chunk.push_back(_arg[0]);
+    }
+  }
+
+private:
+  Expr _function;
+  std::shared_ptr<Env> _env;
+  List _arg;
+  bool _started{false};
+};
+
+class IterateSeq final : public Seq
+{
+public:
+  IterateSeq(Expr function, Expr initial, std::shared_ptr<Env> env)
+    : _function(std::move(function))
+    , _initial(std::move(initial))
+    , _env(std::move(env))
+  {}
+
+  std::unique_ptr<SeqIterator> iter() const final
+  {
+    return std::make_unique<IterateIterator>(_function, _initial, _env);
+  }
+
+private:
+  Expr _function;
+  Expr _initial;
+  std::shared_ptr<Env> _env;
+};
+
+class MapIterator final : public SeqIterator
+{
+public:
+  MapIterator(
+      std::unique_ptr<SeqIterator> inner,
+      Expr function,
+      std::shared_ptr<Env> env)
+    : _inner(std::move(inner))
+    , _function(std::move(function))
+    , _env(std::move(env))
+    , _arg(1)
+  {}
+
+  void next(List& chunk, size_t max) final
+  {
+    _inner->next(chunk, max);
+    for (auto& element : chunk)
+    {
+      _arg[0] = std::move(element);
+      element = Call(_function, _arg, _env);
+    }
+  }
+
+private:
+  std::unique_ptr<SeqIterator> _inner;
+  Expr _function;
+  std::shared_ptr<Env> _env;
+  List _arg;
+};
+
+class FilterIterator final : public SeqIterator
+{
+public:
+  FilterIterator(
+      std::unique_ptr<SeqIterator> inner,
+      Expr function,
+      std::shared_ptr<Env> env)
+    : _inner(std::move(inner))
+    , _function(std::move(function))
+    , _env(std::move(env))
+    , _arg(1)
+  {}
+
+  void next(List& chunk, size_t max) final
+  {
+    // keep pulling until something passes so empty still means exhausted
+    do
+    {
+      _inner->next(chunk, max);
+      if (chunk.empty())
+        return;
+      auto end = std::remove_if(chunk.begin(), chunk.end(), [&](auto& e) {
+        _arg[0] = e;
+        return !Call(_function, _arg, _env).truthy();
+      });
+      chunk.erase(end, chunk.end());
+    } while (chunk.empty());
+  }
+
+private:
+  std::unique_ptr<SeqIterator> _inner;
+  Expr _function;
+  std::shared_ptr<Env> _env;
+  List _arg;
+};
+
+// map and filter share a shape, differing only in their iterator
+template<class Iterator>
+class FunctionSeq final : public Seq
+{
+public:
+  FunctionSeq(Expr function, Expr seq, std::shared_ptr<Env> env)
+    : _function(std::move(function))
+    , _seq(std::move(seq))
+    , _env(std::move(env))
+  {}
+
+  std::unique_ptr<SeqIterator> iter() const final
+  {
+    return std::make_unique<Iterator>(GetSeq(_seq).iter(), _function, _env);
+  }
+
+private:
+  Expr _function;
+  Expr _seq;
+  std::shared_ptr<Env> _env;
+};
+
+class TakeIterator final : public SeqIterator
+{
+public:
+  TakeIterator(std::unique_ptr<SeqIterator> inner, size_t n)
+    : _inner(std::move(inner)), _remaining(n)
+  {}
+
+  void next(List& chunk, size_t max) final
+  {
+    chunk.clear();
+    if (_remaining == 0)
+      return;
+    _inner->next(chunk, std::min(max, _remaining));
+    _remaining -= chunk.size();
+  }
+
+private:
+  std::unique_ptr<SeqIterator> _inner;
+  size_t _remaining;
+};
+
+class DropIterator final : public SeqIterator
+{
+public:
+  DropIterator(std::unique_ptr<SeqIterator> inner, size_t n)
+    : _inner(std::move(inner)), _skip(n)
+  {}
+
+  void next(List& chunk, size_t max) final
+  {
+    while (_skip > 0)
+    {
+      _inner->next(chunk, std::min(kSeqChunkSize, _skip));
+      if (chunk.empty())
+        return;
+      _skip -= chunk.size();
+    }
+    _inner->next(chunk, max);
+  }
+
+private:
+  std::unique_ptr<SeqIterator> _inner;
+  size_t _skip;
+};
+
+template<class Iterator>
+class CountSeq final : public Seq
+{
+public:
+  CountSeq(Expr seq, size_t n)
+    : _seq(std::move(seq))
+    , _n(n)
+  {}
+
+  std::unique_ptr<SeqIterator> iter() const final
+  {
+    return std::make_unique<Iterator>(GetSeq(_seq).iter(), _n);
+  }
+
+private:
+  Expr _seq;
+  size_t _n;
+};
+
+Seq const* AsSeq(Expr const& expr)
+{
+  if (!expr.is_builtin())
+    return nullptr;
+  return dynamic_cast<Seq const*>(expr.get_builtin().function.get());
+}
+
+Promise* AsPromise(Expr const& expr)
+{
+  if (!expr.is_builtin())
+    return nullptr;
+  return dynamic_cast<Promise*>(expr.get_builtin().function.get());
+}
+
+} // namespace
+
+Expr Seq::call(List&, std::shared_ptr<Env>)
+{
+  AFCT_ERROR("Cannot call a seq, realize it first");
+}
+
+Promise::Promise(Expr expr, std::shared_ptr<Env> env)
+  : _expr(std::move(expr)), _env(std::move(env))
+{}
+
+Expr const& Promise::force()
+{
+  if (_forced.load(std::memory_order_acquire))
+    return _expr;
+  AFCT_CHECK(
+      _forcing.load() != std::this_thread::get_id(),
+      "Promise forced while it is being forced");
+
+  // a throwing evaluation leaves the flag unset, so the next force retries;
+  // call_once is not used as it may hang when the callable throws
+  std::lock_guard lock(_mutex);
+  if (!_forced.load(std::memory_order_relaxed))
+  {
+    _forcing = std::this_thread::get_id();
+    try
+    {
+      _expr = Eval(_expr, _env);
+    }
+    catch (...)
+    {
+      _forcing = std::thread::id();
+      throw;
+    }
+    _env.reset();
+    _forcing = std::thread::id();
+    _forced.store(true, std::memory_order_release);
+  }
+  return _expr;
+}
+
+Expr Promise::call(List&, std::shared_ptr<Env>)
+{
+  AFCT_ERROR("Cannot call a promise, force it instead");
+}
+
+bool IsSeq(Expr const& expr)
+{
+  return AsSeq(expr) != nullptr;
+}
+
+Seq const& GetSeq(Expr const& expr)
+{
+  auto seq = AsSeq(expr);
+  AFCT_CHECK(seq, fmt::format("Expected seq but got {}", expr));
+  return *seq;
+}
+
+bool IsPromise(Expr const& expr)
+{
+  return AsPromise(expr) != nullptr;
+}
+
+Promise& GetPromise(Expr const& expr)
+{
+  auto promise = AsPromise(expr);
+  AFCT_CHECK(promise, fmt::format("Expected promise but got {}", expr));
+  return *promise;
+}
+
+Expr LazyRange(int64_t start, std::optional<int64_t> end, int64_t step)
+{
+  AFCT_CHECK(step != 0, "Expected non-zero range step");
+  return NativeFunctionToExpr<RangeSeq>("seq", start, end, step);
+}
+
+Expr LazyIterate(Expr function, Expr initial, std::shared_ptr<Env> env)
+{
+  return NativeFunctionToExpr<IterateSeq>(
+      "seq", std::move(function), std::move(initial), std::move(env));
+}
+
+Expr LazyMap(Expr function, Expr seq, std::shared_ptr<Env> env)
+{
+  GetSeq(seq);
+  return NativeFunctionToExpr<FunctionSeq<MapIterator>>(
+      "seq", std::move(function), std::move(seq), std::move(env));
+}
+
+Expr LazyFilter(Expr function, Expr seq, std::shared_ptr<Env> env)
+{
+  GetSeq(seq);
+  return NativeFunctionToExpr<FunctionSeq<FilterIterator>>(
+      "seq", std::move(function), std::move(seq), std::move(env));
+}
+
+Expr LazyTake(Expr seq, size_t n)
+{
+  GetSeq(seq);
+  return NativeFunctionToExpr<CountSeq<TakeIterator>>("seq", std::move(seq), n);
+}
+
+Expr LazyDrop(Expr seq, size_t n)
+{
+  GetSeq(seq);
+  return NativeFunctionToExpr<CountSeq<DropIterator>>("seq", std::move(seq), n);
+}
+
+List SeqToList(Expr const& seq)
+{
+  auto it = GetSeq(seq).iter();
+  List result;
+  List chunk;
+  while (true)
+  {
+    it->next(chunk, kSeqChunkSize);
+    if (chunk.empty())
+      return result;
+    std::move(chunk.begin(), chunk.end(), std::back_inserter(result));
+  }
+}
+
+} // namespace afct
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "function.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace afct {
+
+// upper bound on elements pulled per step, amortising the virtual calls
+constexpr size_t kSeqChunkSize = 64;
+
+class SeqIterator
+{
+public:
+  virtual ~SeqIterator() = default;
+  // replaces chunk with up to max next elements, empty once exhausted
+  virtual void next(List& chunk, size_t max) = 0;
+};
+
+// a lazy sequence stored as a Builtin; every iter() starts from the
+// beginning, so a seq can be consumed repeatedly without caching elements
+class Seq : public INativeFunction
+{
+public:
+  virtual std::unique_ptr<SeqIterator> iter() const = 0;
+  Expr call(List& args, std::shared_ptr<Env> env) final;
+};
+
+// evaluates its expression on the first force and caches the result; safe
+// to force from several threads. Forcing it again from its own expression
+// throws rather than waiting on itself
+class Promise : public INativeFunction
+{
+public:
+  Promise(Expr expr, std::shared_ptr<Env> env);
+  Expr const& force();
+  Expr call(List& args, std::shared_ptr<Env> env) final;
+
+private:
+  Expr _expr;
+  std::shared_ptr<Env> _env;
+  std::mutex _mutex;
+  std::atomic<bool> _forced{false};
+  // thread evaluating the expression, if any
+  std::atomic<std::thread::id> _forcing;
+};
+
+bool IsSeq(Expr const& expr);
+Seq const& GetSeq(Expr const& expr);
+bool IsPromise(Expr const& expr);
+Promise& GetPromise(Expr const& expr);
+
+// end is exclusive, no end means unbounded
+Expr LazyRange(int64_t start, std::optional<int64_t> end, int64_t step = 1);
+// initial, f(initial), f(f(initial)), ...
+Expr LazyIterate(Expr function, Expr initial, std::shared_ptr<Env> env);
+Expr LazyMap(Expr function, Expr seq, std::shared_ptr<Env> env);
+Expr LazyFilter(Expr function, Expr seq, std::shared_ptr<Env> env);
+Expr LazyTake(Expr seq, size_t n);
+Expr LazyDrop(Expr seq, size_t n);
+// never returns for an unbounded seq
+List SeqToList(Expr const& seq);
+
+// calls f on each element of a list or seq until it returns false
+template<class F>
+void ForEachElement(Expr const& coll, F f)
+{
+  if (coll.is_list())
+  {
+    for (auto const& element : coll.get_list())
+    {
+      if (!f(element))
+        return;
+    }
+    return;
+  }
+
+  auto it = GetSeq(coll).iter();
+  List chunk;
+  while (true)
+  {
+    it->next(chunk, kSeqChunkSize);
+    if (chunk.empty())
+      return;
+    for (auto& element : chunk)
+    {
+      if (!f(std::move(element)))
+        return;
+    }
+  }
+}
+
+} // namespace afct
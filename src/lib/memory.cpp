@@ -0,0 +1,106 @@
+#include "memory.hpp"
+
+#include "util.hpp"
+#include <fmt/format.h>
+#include <utility>
+
+namespace afct {
+
+namespace {
+
+thread_local std::shared_ptr<MemoryAccount> current_account;
+
+} // namespace
+
+MemoryAccount::MemoryAccount(size_t limit, std::pmr::memory_resource* upstream)
+  : _limit(limit)
+  , _upstream(upstream)
+{}
+
+size_t MemoryAccount::bytes() const
+{
+  return _bytes.load(std::memory_order_relaxed);
+}
+
+size_t MemoryAccount::peak() const
+{
+  return _peak.load(std::memory_order_relaxed);
+}
+
+size_t MemoryAccount::limit() const
+{
+  return _limit;
+}
+
+size_t MemoryAccount::objects(MemoryKind kind) const
+{
+  auto count = _objects[static_cast<size_t>(kind)].load();
+  return static_cast<size_t>(std::max<int64_t>(count, 0));
+}
+
+void MemoryAccount::charge(size_t bytes)
+{
+  auto total = _bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  if (_limit > 0 && total > _limit)
+  {
+    _bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    AFCT_ERROR(fmt::format("Memory limit of {} bytes exceeded", _limit));
+  }
+
+  auto peak = _peak.load(std::memory_order_relaxed);
+  while (total > peak && !_peak.compare_exchange_weak(peak, total))
+  {}
+}
+
+void MemoryAccount::refund(size_t bytes)
+{
+  _bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void MemoryAccount::track(MemoryKind kind, int delta)
+{
+  _objects[static_cast<size_t>(kind)].fetch_add(
+      delta, std::memory_order_relaxed);
+}
+
+void* MemoryAccount::do_allocate(size_t bytes, size_t alignment)
+{
+  charge(bytes);
+  try
+  {
+    return _upstream->allocate(bytes, alignment);
+  }
+  catch (...)
+  {
+    refund(bytes);
+    throw;
+  }
+}
+
+void MemoryAccount::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+  _upstream->deallocate(p, bytes, alignment);
+  refund(bytes);
+}
+
+bool MemoryAccount::do_is_equal(
+    std::pmr::memory_resource const& other) const noexcept
+{
+  return this == &other;
+}
+
+MemoryScope::MemoryScope(std::shared_ptr<MemoryAccount> account)
+  : _previous(std::exchange(current_account, std::move(account)))
+{}
+
+MemoryScope::~MemoryScope()
+{
+  current_account = std::move(_previous);
+}
+
+std::shared_ptr<MemoryAccount> const& CurrentAccount()
+{
+  return current_account;
+}
+
+} // namespace afct
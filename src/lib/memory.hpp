@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+
+namespace afct {
+
+// heap objects the account tells apart
+enum class MemoryKind
+{
+  Lambda,
+  Builtin,
+  List,
+  Table,
+  Env
+};
+
+// tallies Expr and Env heap allocations made on a thread while a
+// MemoryScope for it is active, including spawned tasks and parallel
+// chunks run for that thread, and enforces an optional hard limit; it is
+// a memory_resource too, so builders can allocate from it directly
+class MemoryAccount : public std::pmr::memory_resource
+{
+public:
+  explicit MemoryAccount(
+      size_t limit = 0,
+      std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+  size_t bytes() const;
+  size_t peak() const;
+  // 0 for no limit
+  size_t limit() const;
+  size_t objects(MemoryKind kind) const;
+
+  // throws an afct::Exception, charging nothing, past the limit
+  void charge(size_t bytes);
+  void refund(size_t bytes);
+  void track(MemoryKind kind, int delta);
+
+private:
+  void* do_allocate(size_t bytes, size_t alignment) final;
+  void do_deallocate(void* p, size_t bytes, size_t alignment) final;
+  bool do_is_equal(std::pmr::memory_resource const& other) const
+      noexcept final;
+
+  size_t _limit;
+  std::pmr::memory_resource* _upstream;
+  std::atomic<size_t> _bytes{0};
+  std::atomic<size_t> _peak{0};
+  std::array<std::atomic<int64_t>, 5> _objects{};
+};
+
+// makes account current for this thread until destroyed; objects made
+// meanwhile keep it alive and are refunded whichever thread frees them
+class MemoryScope
+{
+public:
+  explicit MemoryScope(std::shared_ptr<MemoryAccount> account);
+  ~MemoryScope();
+  MemoryScope(MemoryScope const&) = delete;
+  MemoryScope& operator=(MemoryScope const&) = delete;
+
+private:
+  std::shared_ptr<MemoryAccount> _previous;
+};
+
+std::shared_ptr<MemoryAccount> const& CurrentAccount();
+
+// charges the node plus extra bytes of contents estimated up front; what a
+// node grows by later, as a list being pushed to or a table under set!,
+// is not charged, so a script can exceed its limit that way
+template<class T>
+class AccountingAllocator
+{
+public:
+  using value_type = T;
+
+  AccountingAllocator(
+      std::shared_ptr<MemoryAccount> account, MemoryKind kind, size_t extra)
+    : _account(std::move(account))
+    , _kind(kind)
+    , _extra(extra)
+  {}
+
+  template<class U>
+  AccountingAllocator(AccountingAllocator<U> const& other)
+    : _account(other._account)
+    , _kind(other._kind)
+    , _extra(other._extra)
+  {}
+
+  T* allocate(size_t n)
+  {
+    _account->charge(_extra);
+    try
+    {
+      auto p = static_cast<T*>(_account->allocate(n * sizeof(T), alignof(T)));
+      _account->track(_kind, 1);
+      return p;
+    }
+    catch (...)
+    {
+      _account->refund(_extra);
+      throw;
+    }
+  }
+
+  void deallocate(T* p, size_t n)
+  {
+    _account->deallocate(p, n * sizeof(T), alignof(T));
+    _account->refund(_extra);
+    _account->track(_kind, -1);
+  }
+
+  template<class U>
+  bool operator==(AccountingAllocator<U> const& other) const
+  {
+    return _account == other._account;
+  }
+
+private:
+  template<class U>
+  friend class AccountingAllocator;
+
+  std::shared_ptr<MemoryAccount> _account;
+  MemoryKind _kind;
+  size_t _extra;
+};
+
+// allocates through the current account, if any; extra is a byte count or
+// a function estimating it, only called when there is an account
+template<class T, class Extra, class... Args>
+std::shared_ptr<T> MakeAccounted(
+    MemoryKind kind, Extra const& extra, Args&&... args)
+{
+  auto const& account = CurrentAccount();
+  if (!account) [[likely]]
+    return std::make_shared<T>(std::forward<Args>(args)...);
+
+  size_t bytes;
+  if constexpr (std::is_invocable_v<Extra const&>)
+    bytes = extra();
+  else
+    bytes = extra;
+  return std::allocate_shared<T>(
+      AccountingAllocator<T>(account, kind, bytes),
+      std::forward<Args>(args)...);
+}
+
+} // namespace afct
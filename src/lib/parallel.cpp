@@ -0,0 +1,158 @@
+#include "parallel.hpp"
+
+#include "async.hpp"
+#include "context.hpp"
+#include "memory.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <fmt/format.h>
+
+namespace afct {
+
+namespace {
+
+// depends only on n so results never vary with the worker count
+size_t ChunkSize(size_t n)
+{
+  return std::max<size_t>(16, (n + 255) / 256);
+}
+
+bool DefaultLess(Expr const& lhs, Expr const& rhs)
+{
+  if (lhs.is_numeric() && rhs.is_numeric())
+    return lhs.get_numeric() < rhs.get_numeric();
+  if (lhs.is_string() && rhs.is_string())
+    return lhs.get_string() < rhs.get_string();
+  AFCT_ERROR(fmt::format("Cannot order {} and {}", lhs, rhs));
+}
+
+// chunks charge the caller's fuel and memory account and see its
+// read-only tables on whichever thread runs them
+void ForChunks(
+    ThreadPool& pool,
+    size_t n,
+    size_t chunk_size,
+    std::function<void(size_t, size_t)> const& f)
+{
+  auto fuel = Fuel::Current();
+  auto account = CurrentAccount();
+  auto read_only = ReadOnlyTables::Current();
+  ParallelFor(pool, n, chunk_size, [&](auto b, auto e) {
+    Fuel::Scope scope(fuel);
+    MemoryScope memory(account);
+    ReadOnlyTables::Scope tables(read_only);
+    f(b, e);
+  });
+}
+
+} // namespace
+
+List ParallelMap(
+    ThreadPool& pool,
+    Expr const& function,
+    List const& list,
+    std::shared_ptr<Env> env)
+{
+  List result(list.size());
+  ForChunks(pool, list.size(), ChunkSize(list.size()), [&](auto b, auto e) {
+    List arg(1);
+    for (auto i = b; i < e; i++)
+    {
+      arg[0] = list[i];
+      result[i] = Call(function, arg, env);
+    }
+  });
+  return result;
+}
+
+List ParallelFilter(
+    ThreadPool& pool,
+    Expr const& function,
+    List const& list,
+    std::shared_ptr<Env> env)
+{
+  std::vector<char> keep(list.size());
+  ForChunks(pool, list.size(), ChunkSize(list.size()), [&](auto b, auto e) {
+    List arg(1);
+    for (auto i = b; i < e; i++)
+    {
+      arg[0] = list[i];
+      keep[i] = Call(function, arg, env).truthy();
+    }
+  });
+
+  List result;
+  for (size_t i = 0; i < list.size(); i++)
+  {
+    if (keep[i])
+      result.push_back(list[i]);
+  }
+  return result;
+}
+
+Expr ParallelReduce(
+    ThreadPool& pool,
+    Expr const& function,
+    Expr init,
+    List const& list,
+    std::shared_ptr<Env> env)
+{
+  auto chunk_size = ChunkSize(list.size());
+  List partials((list.size() + chunk_size - 1) / chunk_size);
+  ForChunks(pool, list.size(), chunk_size, [&](auto b, auto e) {
+    List args{list[b], Expr{}};
+    for (auto i = b + 1; i < e; i++)
+    {
+      args[1] = list[i];
+      args[0] = Call(function, args, env);
+    }
+    partials[b / chunk_size] = std::move(args[0]);
+  });
+
+  List args{std::move(init), Expr{}};
+  for (auto& partial : partials)
+  {
+    args[1] = std::move(partial);
+    args[0] = Call(function, args, env);
+  }
+  return std::move(args[0]);
+}
+
+List ParallelSort(
+    ThreadPool& pool,
+    Expr const& less,
+    List list,
+    std::shared_ptr<Env> env)
+{
+  // each task gets its own argument buffer
+  auto make_less = [&] {
+    return [&, args = List(2)](Expr const& lhs, Expr const& rhs) mutable {
+      if (less.is_null())
+        return DefaultLess(lhs, rhs);
+      args[0] = lhs;
+      args[1] = rhs;
+      return Call(less, args, env).truthy();
+    };
+  };
+
+  auto n = list.size();
+  auto chunk_size = ChunkSize(n);
+  ForChunks(pool, n, chunk_size, [&](auto b, auto e) {
+    std::stable_sort(list.begin() + b, list.begin() + e, make_less());
+  });
+
+  // merge sorted runs pairwise, doubling their width each round
+  for (auto width = chunk_size; width < n; width *= 2)
+  {
+    auto merges = (n + 2 * width - 1) / (2 * width);
+    ForChunks(pool, merges, 1, [&](auto m, auto) {
+      auto begin = list.begin() + m * 2 * width;
+      auto middle = list.begin() + std::min(n, (m * 2 + 1) * width);
+      auto end = list.begin() + std::min(n, (m + 1) * 2 * width);
+      std::inplace_merge(begin, middle, end, make_less());
+    });
+  }
+  return list;
+}
+
+} // namespace afct
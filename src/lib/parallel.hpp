@@ -0,0 +1,36 @@
+#pragma once
+
+#include "function.hpp"
+#include "pool.hpp"
+
+namespace afct {
+
+// functions run concurrently on the pool, so they must not mutate shared
+// tables or envs; results keep the input order whatever the scheduling
+
+List ParallelMap(
+    ThreadPool& pool,
+    Expr const& function,
+    List const& list,
+    std::shared_ptr<Env> env);
+List ParallelFilter(
+    ThreadPool& pool,
+    Expr const& function,
+    List const& list,
+    std::shared_ptr<Env> env);
+// function must be associative: chunks are folded independently and
+// their results then folded left to right onto init
+Expr ParallelReduce(
+    ThreadPool& pool,
+    Expr const& function,
+    Expr init,
+    List const& list,
+    std::shared_ptr<Env> env);
+// stable; a null less orders numbers and strings
+List ParallelSort(
+    ThreadPool& pool,
+    Expr const& less,
+    List list,
+    std::shared_ptr<Env> env);
+
+} // namespace afct
@@ -0,0 +1,196 @@
+#include "pool.hpp"
+
+#include "util.hpp"
+#include <charconv>
+#include <cstdlib>
+#include <exception>
+#include <fmt/format.h>
+#include <string_view>
+
+namespace afct {
+
+namespace {
+
+// index of the queue owned by the current thread in its pool
+thread_local ThreadPool const* current_pool = nullptr;
+thread_local size_t current_index = 0;
+
+// more would only come from a typo, and each one is a thread
+constexpr size_t kMaxWorkers = 1024;
+
+size_t DefaultWorkers()
+{
+  if (auto workers = std::getenv("AFCT_WORKERS"))
+  {
+    std::string_view text(workers);
+    auto end = text.data() + text.size();
+    size_t count = 0;
+    auto [last, ec] = std::from_chars(text.data(), end, count);
+    AFCT_CHECK(
+        ec == std::errc() && last == end && count <= kMaxWorkers,
+        fmt::format("Invalid AFCT_WORKERS {}", workers));
+    return count;
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t workers)
+{
+  // always keep one queue so tasks can be submitted with no workers
+  for (size_t i = 0; i < std::max<size_t>(workers, 1); i++)
+    _queues.push_back(std::make_unique<Queue>());
+  for (size_t i = 0; i < workers; i++)
+    _threads.emplace_back([this, i] { work(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (auto& thread : _threads)
+    thread.join();
+}
+
+size_t ThreadPool::size() const
+{
+  return _threads.size();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+  auto index = current_pool == this ? current_index
+                                    : _next++ % _queues.size();
+  {
+    std::lock_guard lock(_queues[index]->mutex);
+    _queues[index]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard lock(_mutex);
+    _pending++;
+  }
+  _wake.notify_one();
+}
+
+ThreadPool& ThreadPool::Default()
+{
+  static ThreadPool pool(DefaultWorkers());
+  return pool;
+}
+
+void ThreadPool::work(size_t index)
+{
+  current_pool = this;
+  current_index = index;
+
+  std::function<void()> task;
+  while (true)
+  {
+    if (pop(index, task))
+    {
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock lock(_mutex);
+    _wake.wait(lock, [this] { return _stop || _pending > 0; });
+    if (_stop && _pending == 0)
+      return;
+  }
+}
+
+bool ThreadPool::pop(size_t index, std::function<void()>& task)
+{
+  for (size_t i = 0; i < _queues.size(); i++)
+  {
+    auto& queue = *_queues[(index + i) % _queues.size()];
+    std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty())
+      continue;
+
+    // own work is taken newest first while it is hot in cache, stolen
+    // work oldest first
+    if (i == 0)
+    {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    }
+    else
+    {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+
+    std::lock_guard pending_lock(_mutex);
+    _pending--;
+    return true;
+  }
+  return false;
+}
+
+void ParallelFor(
+    ThreadPool& pool,
+    size_t n,
+    size_t chunk_size,
+    std::function<void(size_t, size_t)> const& f)
+{
+  AFCT_CHECK(chunk_size > 0, "Expected non-zero chunk size");
+
+  // shared with jobs that may only start after the caller has returned,
+  // which touch nothing else once every chunk is claimed
+  struct Chunks
+  {
+    size_t n;
+    size_t chunk_size;
+    size_t count;
+    std::function<void(size_t, size_t)> const& f;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> remaining;
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    void run()
+    {
+      for (auto c = next++; c < count; c = next++)
+      {
+        try
+        {
+          // later chunks are skipped once one has failed
+          if (!failed)
+            f(c * chunk_size, std::min(n, (c + 1) * chunk_size));
+        }
+        catch (...)
+        {
+          std::lock_guard lock(error_mutex);
+          if (!error)
+            error = std::current_exception();
+          failed = true;
+        }
+        if (--remaining == 0)
+          remaining.notify_all();
+      }
+    }
+  };
+
+  auto count = (n + chunk_size - 1) / chunk_size;
+  auto chunks = std::make_shared<Chunks>(n, chunk_size, count, f);
+  chunks->remaining = count;
+  for (size_t i = 1; i < std::min(count, pool.size() + 1); i++)
+    pool.submit([chunks] { chunks->run(); });
+
+  chunks->run();
+  for (auto left = chunks->remaining.load(); left > 0;
+       left = chunks->remaining.load())
+    chunks->remaining.wait(left);
+
+  if (chunks->error)
+    std::rethrow_exception(chunks->error);
+}
+
+} // namespace afct
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace afct {
+
+// work-stealing pool: each worker owns a deque and runs from its back,
+// idle workers steal from the front of the others
+class ThreadPool
+{
+public:
+  explicit ThreadPool(size_t workers);
+  ~ThreadPool();
+  ThreadPool(ThreadPool const&) = delete;
+  ThreadPool& operator=(ThreadPool const&) = delete;
+
+  size_t size() const;
+  void submit(std::function<void()> task);
+
+  // shared pool sized by AFCT_WORKERS, else the hardware concurrency
+  static ThreadPool& Default();
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void work(size_t index);
+  bool pop(size_t index, std::function<void()>& task);
+
+  std::vector<std::unique_ptr<Queue>> _queues;
+  std::vector<std::thread> _threads;
+  std::atomic<size_t> _next{0};
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  size_t _pending{0};
+  bool _stop{false};
+};
+
+// calls f(begin, end) for consecutive chunks of [0, n); the caller and
+// up to one job per worker claim chunks in turn, then the caller blocks
+// until the chunks workers took have finished, never running other tasks
+// meanwhile. The first exception is rethrown once all chunks have finished
+void ParallelFor(
+    ThreadPool& pool,
+    size_t n,
+    size_t chunk_size,
+    std::function<void(size_t, size_t)> const& f);
+
+} // namespace afct
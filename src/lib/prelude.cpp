@@ -1,9 +1,18 @@
 #include "prelude.hpp"
 
+#include "async.hpp"
+#include "context.hpp"
+#include "csv.hpp"
 #include "eval.hpp"
 #include "function.hpp"
+#include "lazy.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
 #include "parse.hpp"
+#include "task.hpp"
+#include "transduce.hpp"
 #include "util.hpp"
+#include <algorithm>
 #include <cstdlib>
 #include <fmt/format.h>
 #include <fmt/ostream.h>
@@ -281,6 +290,10 @@ Expr SetBang(List& args, std::shared_ptr<Env>)
       "Expected 3 args to set!, table first");
 
   auto& table = args[0].get_table();
+  auto const& read_only = ReadOnlyTables::Current();
+  AFCT_CHECK(
+      !read_only || !read_only->contains(table),
+      fmt::format("Cannot set! a read-only table {}", args[0]));
   auto const& key = args[1];
   auto const& value = args[2];
   table[key] = value;
@@ -384,14 +397,24 @@ Expr Apply(List& args, std::shared_ptr<Env> env)
 
 Expr Map(List& args, std::shared_ptr<Env> env)
 {
+  if (args.size() == 1 && args[0].is_function())
+    return MakeTransducer({{TransducerStep::Kind::Map, args[0]}});
+
   AFCT_ARG_CHECK(
-      args.size() == 2 && args[0].is_function() && args[1].is_list(),
-      "Expected function and list args to map");
+      args.size() == 2 && args[0].is_function() &&
+          (args[1].is_list() || IsSeq(args[1])),
+      "Expected function and list or seq args to map");
+
+  if (IsSeq(args[1]))
+    return LazyMap(args[0], args[1], env);
 
+  auto const& input = args[1].get_list();
   List result;
-  for (auto const& element : args[1].get_list())
+  result.reserve(input.size());
+  List arg(1);
+  for (auto const& element : input)
   {
-    std::vector<Expr> arg{element};
+    arg[0] = element;
     result.push_back(Call(args[0], arg, env));
   }
   return Expr{std::move(result)};
@@ -399,20 +422,271 @@ Expr Map(List& args, std::shared_ptr<Env> env)
 
 Expr Filter(List& args, std::shared_ptr<Env> env)
 {
+  if (args.size() == 1 && args[0].is_function())
+    return MakeTransducer({{TransducerStep::Kind::Filter, args[0]}});
+
   AFCT_ARG_CHECK(
-      args.size() == 2 && args[0].is_function() && args[1].is_list(),
-      "Expected function and list args to filter");
+      args.size() == 2 && args[0].is_function() &&
+          (args[1].is_list() || IsSeq(args[1])),
+      "Expected function and list or seq args to filter");
+
+  if (IsSeq(args[1]))
+    return LazyFilter(args[0], args[1], env);
 
   List result;
+  List arg(1);
   for (auto const& element : args[1].get_list())
   {
-    std::vector<Expr> arg{element};
+    arg[0] = element;
     if (Call(args[0], arg, env).truthy())
       result.push_back(element);
   }
   return Expr{std::move(result)};
 }
 
+Expr Comp(List& args, std::shared_ptr<Env>)
+{
+  AFCT_ARG_CHECK(
+      std::all_of(args.begin(), args.end(), IsTransducer),
+      "Expected transducer args to comp");
+
+  return Compose(args);
+}
+
+Expr Transduced(List& args, std::shared_ptr<Env> env)
+{
+  AFCT_ARG_CHECK(
+      args.size() == 4 && IsTransducer(args[0]) && args[1].is_function() &&
+          (args[3].is_list() || IsSeq(args[3])),
+      "Expected transducer, function, initial value and list or seq args to "
+      "transduce");
+
+  return Transduce(args[0], args[1], std::move(args[2]), args[3], env);
+}
+
+Expr Fold(List& args, std::shared_ptr<Env> env)
+{
+  AFCT_ARG_CHECK(
+      args.size() == 3 && args[0].is_function() &&
+          (args[2].is_list() || IsSeq(args[2])),
+      "Expected function, initial value and list or seq args to reduce");
+
+  List call_args{std::move(args[1]), Expr{}};
+  ForEachElement(args[2], [&](Expr element) {
+    call_args[1] = std::move(element);
+    call_args[0] = Call(args[0], call_args, env);
+    return true;
+  });
+  return std::move(call_args[0]);
+}
+
+Expr IntoList(List& args, std::shared_ptr<Env> env)
+{
+  AFCT_ARG_CHECK(
+      args.size() == 3 && args[0].is_list() && IsTransducer(args[1]) &&
+          (args[2].is_list() || IsSeq(args[2])),
+      "Expected list, transducer and list or seq args to into");
+
+  return Expr{Into(args[0].get_list(), args[1], args[2], env)};
+}
+
+Expr PMap(List& args, std::shared_ptr<Env> env)
+{
+  AFCT_ARG_CHECK(
+      args.size() == 2 && args[0].is_function() && args[1].is_list(),
+      "Expected function and list args to pmap");
+
+  return Expr{
+      ParallelMap(ThreadPool::Default(), args[0], args[1].get_list(), env)};
+}
+
+Expr PFilter(List& args, std::shared_ptr<Env> env)
+{
+  AFCT_ARG_CHECK(
+      args.size() == 2 && args[0].is_function() && args[1].is_list(),
+      "Expected function and list args to pfilter");
+
+  return Expr{
+      ParallelFilter(ThreadPool::Default(), args[0], args[1].get_list(), env)};
+}
+
+Expr PReduce(List& args, std::shared_ptr<Env> env)
+{
+  AFCT_ARG_CHECK(
+      args.size() == 3 && args[0].is_function() && args[2].is_list(),
+      "Expected function, initial value and list args to preduce");
+
+  return ParallelReduce(
+      ThreadPool::Default(), args[0], args[1], args[2].get_list(), env);
+}
+
+Expr PSort(List& args, std::shared_ptr<Env> env)
+{
+  AFCT_ARG_CHECK(
+      (args.size() == 1 && args[0].is_list()) ||
+          (args.size() == 2 && args[0].is_function() && args[1].is_list()),
+      "Expected optional function and list args to psort");
+
+  auto less = args.size() == 2 ? args[0] : Expr{};
+  return Expr{ParallelSort(
+      ThreadPool::Default(), less, args.back().get_list(), env)};
+}
+
+// the spawning thread goes on defining into the envs a task reads, so
+// they are shared first; envs only reachable through tables are not
+void ShareEnvs(std::shared_ptr<Env> const& env)
+{
+  for (auto e = env.get(); e; e = e->outer().get())
+    e->share();
+}
+
+Expr SpawnCall(List& args, std::shared_ptr<Env> env)
+{
+  AFCT_ARG_CHECK(
+      !args.empty() && args[0].is_function(),
+      "Expected function and its args to spawn");
+
+  ShareEnvs(env);
+  for (auto const& arg : args)
+  {
+    if (arg.is_lambda())
+      ShareEnvs(arg.get_lambda().env);
+  }
+
+  auto function = args[0];
+  List call_args(args.begin() + 1, args.end());
+  // the task charges the spawning script's fuel and memory account, even
+  // if it outlives the script, and sees the same read-only tables
+  std::shared_ptr<Fuel> fuel;
+  if (auto current = Fuel::Current())
+    fuel = current->weak_from_this().lock();
+  return Spawn(
+      ThreadPool::Default(),
+      [function,
+       call_args = std::move(call_args),
+       env,
+       fuel,
+       account = CurrentAccount(),
+       read_only = ReadOnlyTables::Current()]() mutable {
+        Fuel::Scope scope(fuel.get());
+        MemoryScope memory(account);
+        ReadOnlyTables::Scope tables(read_only);
+        return Call(function, call_args, env);
+      });
+}
+
+Expr AwaitTask(List& args, std::shared_ptr<Env>)
+{
+  AFCT_ARG_CHECK(
+      args.size() == 1 && IsTask(args[0]), "Expected 1 task arg to await");
+
+  return Await(args[0]);
+}
+
+Expr All(List& args, std::shared_ptr<Env>)
+{
+  // either the tasks themselves or a single list of them
+  auto const& tasks =
+      args.size() == 1 && args[0].is_list() ? args[0].get_list() : args;
+  AFCT_ARG_CHECK(
+      std::all_of(tasks.begin(), tasks.end(), IsTask),
+      "Expected task args or a list of tasks to all");
+
+  return Expr{AwaitAll(tasks)};
+}
+
+Expr Range(List& args, std::shared_ptr<Env>)
+{
+  AFCT_ARG_CHECK(
+      args.size() <= 3 &&
+          std::all_of(
+              args.begin(), args.end(), [](auto& a) { return a.is_int(); }),
+      "Expected up to 3 int args to range");
+
+  switch (args.size())
+  {
+  case 0: return LazyRange(0, {});
+  case 1: return LazyRange(0, args[0].get_int());
+  case 2: return LazyRange(args[0].get_int(), args[1].get_int());
+  default:
+    AFCT_ARG_CHECK(args[2].get_int() != 0, "Expected non-zero step to range");
+    return LazyRange(
+        args[0].get_int(), args[1].get_int(), args[2].get_int());
+  }
+}
+
+Expr Iterate(List& args, std::shared_ptr<Env> env)
+{
+  AFCT_ARG_CHECK(
+      args.size() == 2 && args[0].is_function(),
+      "Expected function and initial value args to iterate");
+
+  return LazyIterate(args[0], args[1], env);
+}
+
+Expr Take(List& args, std::shared_ptr<Env>)
+{
+  if (args.size() == 1 && args[0].is_int() && args[0].get_int() >= 0)
+  {
+    auto n = static_cast<size_t>(args[0].get_int());
+    return MakeTransducer({{TransducerStep::Kind::Take, Expr{}, n}});
+  }
+
+  AFCT_ARG_CHECK(
+      args.size() == 2 && args[0].is_int() && args[0].get_int() >= 0 &&
+          (args[1].is_list() || IsSeq(args[1])),
+      "Expected count and list or seq args to take");
+
+  auto n = static_cast<size_t>(args[0].get_int());
+  if (IsSeq(args[1]))
+    return LazyTake(args[1], n);
+
+  auto const& list = args[1].get_list();
+  return Expr{List(list.begin(), list.begin() + std::min(n, list.size()))};
+}
+
+Expr Drop(List& args, std::shared_ptr<Env>)
+{
+  if (args.size() == 1 && args[0].is_int() && args[0].get_int() >= 0)
+  {
+    auto n = static_cast<size_t>(args[0].get_int());
+    return MakeTransducer({{TransducerStep::Kind::Drop, Expr{}, n}});
+  }
+
+  AFCT_ARG_CHECK(
+      args.size() == 2 && args[0].is_int() && args[0].get_int() >= 0 &&
+          (args[1].is_list() || IsSeq(args[1])),
+      "Expected count and list or seq args to drop");
+
+  auto n = static_cast<size_t>(args[0].get_int());
+  if (IsSeq(args[1]))
+    return LazyDrop(args[1], n);
+
+  auto const& list = args[1].get_list();
+  return Expr{List(list.begin() + std::min(n, list.size()), list.end())};
+}
+
+Expr Realize(List& args, std::shared_ptr<Env>)
+{
+  AFCT_ARG_CHECK(
+      args.size() == 1 && (args[0].is_list() || IsSeq(args[0])),
+      "Expected 1 list or seq arg to realize");
+
+  if (args[0].is_list())
+    return args[0];
+  return Expr{SeqToList(args[0])};
+}
+
+Expr Force(List& args, std::shared_ptr<Env>)
+{
+  AFCT_ARG_CHECK(args.size() == 1, "Expected 1 arg to force");
+
+  // forcing a plain value is a no-op, as in scheme
+  if (!IsPromise(args[0]))
+    return args[0];
+  return GetPromise(args[0]).force();
+}
+
 Expr Print(List& args, std::shared_ptr<Env>)
 {
   AFCT_ARG_CHECK(args.size() == 1, "Expected 1 arg to print");
@@ -449,34 +723,98 @@ Expr Rand(List& args, std::shared_ptr<Env>)
   return Expr{static_cast<int64_t>(dist(rng))};
 }
 
-std::shared_ptr<Env> Prelude()
+Expr ReadCsvFile(List& args, std::shared_ptr<Env>)
 {
-  auto prelude = std::make_shared<Env>();
+  AFCT_ARG_CHECK(
+      (args.size() == 1 || (args.size() == 2 && args[1].is_table())) &&
+          args[0].is_string(),
+      "Expected path and optional options table to read-csv");
+
+  CsvOptions options;
+  if (args.size() == 2)
+  {
+    auto const& table = args[1].get_table();
+    auto option = [&](char const* name) -> Expr const* {
+      auto it = table.find(Expr{String{name}});
+      return it == table.end() ? nullptr : &it->second;
+    };
+
+    if (auto delimiter = option("delimiter"))
+    {
+      AFCT_ARG_CHECK(
+          delimiter->is_string() && delimiter->get_string().size() == 1,
+          "Expected single character delimiter to read-csv");
+      options.delimiter = delimiter->get_string()[0];
+    }
+    if (auto header = option("header"))
+      options.header = header->truthy();
+    if (auto types = option("types"))
+      options.infer_types = types->truthy();
+    if (auto columns = option("columns"))
+      options.columns = columns->truthy();
+  }
+
+  return ReadCsv(std::filesystem::path(args[0].get_string()), options);
+}
+
+namespace {
+
+std::shared_ptr<Env> MakeBuiltins()
+{
+  // built once for the whole process, so never charged to whichever
+  // account happens to be current on first use
+  MemoryScope unaccounted(nullptr);
 
   std::vector<
       std::pair<std::string, std::function<Expr(List&, std::shared_ptr<Env>)>>>
-      symbol_and_function{{"=", Eq},          {"+", Add},
-                          {"-", Sub},         {"*", Mult},
-                          {"/", Div},         {"<", LessThan},
-                          {">", GreaterThan}, {"and", And},
-                          {"or", Or},         {"not", Not},
-                          {"min", Min},       {"max", Max},
-                          {"list", ToList},   {"table", ToTable},
-                          {"length", Length}, {"append", Append},
-                          {"cons", Cons},     {"car", Car},
-                          {"cdr", Cdr},       {"cat", Cat},
-                          {"get", Get},       {"set!", SetBang},
-                          {"keys", Keys},     {"values", Values},
-                          {"bool", Bool},     {"double", Double},
-                          {"int", Int},       {"string", ToString},
-                          {"apply", Apply},   {"map", Map},
-                          {"filter", Filter}, {"print", Print},
-                          {"getenv", GetEnv}, {"rand", Rand}};
-  for (auto& pair : symbol_and_function)
-    prelude->set(
-        pair.first, StdFunctionToExpr(pair.first, std::move(pair.second)));
-
-  return prelude;
+      symbol_and_function{{"=", Eq},                 {"+", Add},
+                          {"-", Sub},                {"*", Mult},
+                          {"/", Div},                {"<", LessThan},
+                          {">", GreaterThan},        {"and", And},
+                          {"or", Or},                {"not", Not},
+                          {"min", Min},              {"max", Max},
+                          {"list", ToList},          {"table", ToTable},
+                          {"length", Length},        {"append", Append},
+                          {"cons", Cons},            {"car", Car},
+                          {"cdr", Cdr},              {"cat", Cat},
+                          {"get", Get},              {"set!", SetBang},
+                          {"keys", Keys},            {"values", Values},
+                          {"bool", Bool},            {"double", Double},
+                          {"int", Int},              {"string", ToString},
+                          {"apply", Apply},          {"map", Map},
+                          {"filter", Filter},        {"print", Print},
+                          {"getenv", GetEnv},        {"rand", Rand},
+                          {"read-csv", ReadCsvFile}, {"range", Range},
+                          {"iterate", Iterate},      {"take", Take},
+                          {"drop", Drop},            {"realize", Realize},
+                          {"force", Force},          {"comp", Comp},
+                          {"transduce", Transduced}, {"reduce", Fold},
+                          {"into", IntoList},        {"pmap", PMap},
+                          {"pfilter", PFilter},      {"preduce", PReduce},
+                          {"psort", PSort},          {"spawn", SpawnCall},
+                          {"await", AwaitTask},      {"all", All}};
+  std::vector<std::pair<std::string, Expr>> bindings;
+  bindings.reserve(symbol_and_function.size() + 2);
+  for (auto& [symbol, function] : symbol_and_function)
+    bindings.emplace_back(symbol, StdFunctionToExpr(symbol, function));
+  bindings.emplace_back("sleep", NativeFunctionToExpr<SleepFunction>("sleep"));
+  bindings.emplace_back(
+      "read-file", NativeFunctionToExpr<ReadFileFunction>("read-file"));
+
+  return Env::Frozen(std::move(bindings));
+}
+
+} // namespace
+
+std::shared_ptr<Env> const& Builtins()
+{
+  static auto const builtins = MakeBuiltins();
+  return builtins;
+}
+
+std::shared_ptr<Env> Prelude()
+{
+  return Env::Make(Builtins());
 }
 
 } // namespace afct
@@ -35,10 +35,31 @@ Expr ToString(List& args, std::shared_ptr<Env>);
 Expr Apply(List& args, std::shared_ptr<Env> env);
 Expr Map(List& args, std::shared_ptr<Env> env);
 Expr Filter(List& args, std::shared_ptr<Env> env);
+Expr Comp(List& args, std::shared_ptr<Env>);
+Expr Transduced(List& args, std::shared_ptr<Env> env);
+Expr Fold(List& args, std::shared_ptr<Env> env);
+Expr IntoList(List& args, std::shared_ptr<Env> env);
+Expr PMap(List& args, std::shared_ptr<Env> env);
+Expr PFilter(List& args, std::shared_ptr<Env> env);
+Expr PReduce(List& args, std::shared_ptr<Env> env);
+Expr PSort(List& args, std::shared_ptr<Env> env);
+Expr SpawnCall(List& args, std::shared_ptr<Env> env);
+Expr AwaitTask(List& args, std::shared_ptr<Env>);
+Expr All(List& args, std::shared_ptr<Env>);
+Expr Range(List& args, std::shared_ptr<Env>);
+Expr Iterate(List& args, std::shared_ptr<Env> env);
+Expr Take(List& args, std::shared_ptr<Env>);
+Expr Drop(List& args, std::shared_ptr<Env>);
+Expr Realize(List& args, std::shared_ptr<Env>);
+Expr Force(List& args, std::shared_ptr<Env>);
 Expr Print(List& args, std::shared_ptr<Env>);
 Expr GetEnv(List& args, std::shared_ptr<Env>);
 Expr Rand(List& args, std::shared_ptr<Env>);
+Expr ReadCsvFile(List& args, std::shared_ptr<Env>);
 
+// one frozen env of every builtin, shared by the whole process
+std::shared_ptr<Env> const& Builtins();
+// a fresh env on top of the builtins; cheap, nothing is copied
 std::shared_ptr<Env> Prelude();
 
 } // namespace afct
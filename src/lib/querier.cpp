@@ -1,42 +1,259 @@
 #include "querier.hpp"
 
-#include "parse.hpp"
+#include <charconv>
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 
 namespace afct {
 
+namespace {
+
+// equivalent to Parse for a single path element, without lexing
+Expr ParseKey(std::string_view element)
+{
+  if (element == "null")
+    return Expr{};
+  if (element == "true")
+    return Expr{true};
+  if (element == "false")
+    return Expr{false};
+  if (element.size() >= 2 && element.front() == '"' && element.back() == '"')
+    return Expr{String{std::string(element.substr(1, element.size() - 2))}};
+
+  auto const* first = element.data();
+  auto const* last = first + element.size();
+  if (element.find('.') != std::string_view::npos)
+  {
+    double d;
+    auto [end, error] = std::from_chars(first, last, d);
+    if (error == std::errc() && end == last)
+      return Expr{d};
+  }
+  else
+  {
+    int64_t i;
+    auto [end, error] = std::from_chars(first, last, i);
+    if (error == std::errc() && end == last)
+      return Expr{i};
+  }
+
+  // names in paths refer to string keys
+  return Expr{String{std::string(element)}};
+}
+
+List const* UnquotedList(Expr const& expr)
+{
+  if (!expr.is_list())
+    return nullptr;
+
+  if (IsQuote(expr))
+  {
+    auto const& list = expr.get_list();
+    if (list.size() == 2 && list[1].is_list())
+      return &list[1].get_list();
+  }
+
+  return &expr.get_list();
+}
+
+Expr const* Lookup(Expr const& expr, Expr const& key)
+{
+  if (expr.is_table())
+  {
+    auto const& table = expr.get_table();
+    auto it = table.find(key);
+    return it == table.end() ? nullptr : &it->second;
+  }
+
+  auto list = UnquotedList(expr);
+  if (list && key.is_int())
+  {
+    auto i = key.get_int();
+    if (i >= 0 && static_cast<size_t>(i) < list->size())
+      return &(*list)[i];
+  }
+
+  return nullptr;
+}
+
+template<class F>
+void ForEachElement(std::string_view path, F f)
+{
+  size_t start = 0;
+  while (start <= path.size())
+  {
+    auto end = path.find('/', start);
+    if (end == std::string_view::npos)
+      end = path.size();
+    auto element = path.substr(start, end - start);
+    start = end + 1;
+
+    if (!element.empty() && !f(element))
+      return;
+  }
+}
+
+} // namespace
+
+Path ParsePath(std::string_view path)
+{
+  Path result;
+  ForEachElement(path, [&](std::string_view element) {
+    if (element == "*")
+      result.push_back({PathSegment::Kind::Wildcard, Expr{}});
+    else if (element == "**")
+      result.push_back({PathSegment::Kind::Descend, Expr{}});
+    else
+      result.push_back({PathSegment::Kind::Key, ParseKey(element)});
+    return true;
+  });
+  return result;
+}
+
+QueryIterator::QueryIterator(std::shared_ptr<Path const> path, Expr const* root)
+  : _path(std::move(path))
+{
+  _stack.push_back({root, 0});
+  advance();
+}
+
+Expr const& QueryIterator::operator*() const
+{
+  return *_current;
+}
+
+Expr const* QueryIterator::operator->() const
+{
+  return _current;
+}
+
+QueryIterator& QueryIterator::operator++()
+{
+  advance();
+  return *this;
+}
+
+void QueryIterator::operator++(int)
+{
+  advance();
+}
+
+bool QueryIterator::operator==(std::default_sentinel_t) const
+{
+  return !_current;
+}
+
+void QueryIterator::advance()
+{
+  while (!_stack.empty())
+  {
+    auto& frame = _stack.back();
+    auto expr = frame.expr;
+    auto segment = frame.segment;
+
+    if (segment == _path->size())
+    {
+      _stack.pop_back();
+      _current = expr;
+      return;
+    }
+
+    auto const& element = (*_path)[segment];
+    if (element.kind == PathSegment::Kind::Key)
+    {
+      _stack.pop_back();
+      if (auto child = Lookup(*expr, element.key))
+        _stack.push_back({child, segment + 1});
+      continue;
+    }
+
+    auto list = UnquotedList(*expr);
+    if (!frame.started)
+    {
+      frame.started = true;
+      if (expr->is_table())
+        frame.it = expr->get_table().begin();
+
+      // ** also matches zero levels, so try the rest of the path here first
+      if (element.kind == PathSegment::Kind::Descend)
+      {
+        _stack.push_back({expr, segment + 1});
+        continue;
+      }
+    }
+
+    Expr const* child = nullptr;
+    if (list && frame.index < list->size())
+      child = &(*list)[frame.index++];
+    else if (expr->is_table() && frame.it != expr->get_table().end())
+      child = &(frame.it++)->second;
+
+    if (!child)
+    {
+      _stack.pop_back();
+      continue;
+    }
+
+    if (element.kind == PathSegment::Kind::Wildcard)
+      _stack.push_back({child, segment + 1});
+    else
+      _stack.push_back({child, segment});
+  }
+
+  _current = nullptr;
+}
+
+QueryRange::QueryRange(Path path, Expr const* root)
+  : _path(std::make_shared<Path const>(std::move(path))), _root(root)
+{}
+
+QueryIterator QueryRange::begin() const
+{
+  return QueryIterator(_path, _root);
+}
+
+std::default_sentinel_t QueryRange::end() const
+{
+  return std::default_sentinel;
+}
+
 Querier::Querier() : _root(Expr{})
 {}
 
 Querier::Querier(Expr expr) : _root(expr)
 {}
 
+Querier::Querier(std::shared_ptr<Image const> image) : _image(std::move(image))
+{}
+
 bool Querier::get_list(std::string const& path, std::vector<Expr>& result) const
 {
-  auto elements = Split("/", path);
-  Expr expr;
-  if (!find(elements, expr))
-    return false;
-
-  if (expr.is_list())
+  Expr decoded;
+  Expr const* expr = nullptr;
+  if (_image)
   {
-    if (IsQuote(expr))
+    auto view = find_image_view(path);
+    if (view)
     {
-      auto const& unquoted = Unquote(expr);
-      if (unquoted.is_list())
-      {
-        result = unquoted.get_list();
-        return true;
-      }
+      decoded = view->to_expr();
+      expr = &decoded;
     }
+  }
+  else
+  {
+    expr = find_view(path);
+  }
+  if (!expr)
+    return false;
 
-    result = expr.get_list();
+  if (auto list = UnquotedList(*expr))
+  {
+    result = *list;
     return true;
   }
-  else if (expr.is_table())
+  else if (expr->is_table())
   {
-    for (auto const& pair : expr.get_table())
+    for (auto const& pair : expr->get_table())
       result.push_back(Expr{List{pair.first, pair.second}});
     return true;
   }
@@ -150,31 +367,236 @@ bool Querier::get<Expr>(Expr const& expr, Expr& result) const
   return true;
 }
 
-bool Querier::find(std::vector<std::string> const& elements, Expr& result) const
+Expr const* Querier::find_view(std::string_view path) const
+{
+  AFCT_CHECK(!_image, "Querier on an image has no in-memory views");
+
+  Expr const* expr = &_root;
+  ForEachElement(path, [&](std::string_view element) {
+    expr = Lookup(*expr, ParseKey(element));
+    return expr != nullptr;
+  });
+  return expr;
+}
+
+Expr const& Querier::get_view(std::string_view path) const
+{
+  auto expr = find_view(path);
+  AFCT_CHECK(expr, fmt::format("Failed to get from {} in {}", path, _root));
+  return *expr;
+}
+
+bool Querier::get_list_view(
+    std::string_view path, std::span<Expr const>& result) const
+{
+  auto expr = find_view(path);
+  if (!expr)
+    return false;
+
+  auto list = UnquotedList(*expr);
+  if (!list)
+    return false;
+
+  result = std::span<Expr const>(list->data(), list->size());
+  return true;
+}
+
+std::span<Expr const> Querier::get_list_view(std::string_view path) const
+{
+  std::span<Expr const> result;
+  AFCT_CHECK(
+      get_list_view(path, result), fmt::format("List for {} not found", path));
+  return result;
+}
+
+TableView Querier::get_table_view(std::string_view path) const
+{
+  auto expr = find_view(path);
+  AFCT_CHECK(
+      expr && expr->is_table(), fmt::format("Table for {} not found", path));
+  return TableView(expr->get_table());
+}
+
+KeysView Querier::get_keys(std::string_view path) const
+{
+  return KeysView(get_table_view(path));
+}
+
+ValuesView Querier::get_values(std::string_view path) const
+{
+  return ValuesView(get_table_view(path));
+}
+
+QueryRange Querier::query(std::string_view path) const
+{
+  AFCT_CHECK(!_image, "Querier on an image has no in-memory views");
+  return QueryRange(ParsePath(path), &_root);
+}
+
+std::optional<ImageView> Querier::find_image_view(std::string_view path) const
 {
-  auto expr = _root;
-  for (auto const& element : elements)
+  AFCT_CHECK(_image, "Querier has no image");
+
+  std::optional<ImageView> view = _image->root();
+  ForEachElement(path, [&](std::string_view element) {
+    auto key = ParseKey(element);
+    auto type = view->get_type();
+
+    // quoted lists read through to the list, as in UnquotedList
+    if (type == Type::List && view->size() == 2 && view->at(1).is_list())
+    {
+      auto first = view->at(0);
+      if (first.get_type() == Type::Name &&
+          (first.get_name() == "quote" || first.get_name() == "'"))
+      {
+        view = view->at(1);
+        type = view->get_type();
+      }
+    }
+
+    if (type == Type::Table)
+      view = view->find(key);
+    else if (view->is_list() && key.is_int() && key.get_int() >= 0 &&
+             static_cast<size_t>(key.get_int()) < view->size())
+      view = view->at(key.get_int());
+    else
+      view = std::nullopt;
+    return view.has_value();
+  });
+  return view;
+}
+
+void Querier::set_root(Expr expr)
+{
+  std::lock_guard lock(_mutex);
+  _image = nullptr;
+  _root = std::move(expr);
+  for (auto& [path, fields] : _indexes)
   {
-    if (element.empty())
-      continue;
+    for (auto& [field, index] : fields)
+      index = Index{};
+  }
+}
 
-    if (!expr.is_table())
-      return false;
+void Querier::index(std::string path, std::string field)
+{
+  std::lock_guard lock(_mutex);
+  _indexes[std::move(path)][std::move(field)] = Index{};
+}
 
-    Expr key = Parse(element);
-    if (key.is_name())
-      key = Expr{String{key.get_name()}};
+Expr const* Querier::find_by(
+    std::string_view path, std::string_view field, Expr const& key) const
+{
+  std::lock_guard lock(_mutex);
+  auto index = find_index(path, field);
+  AFCT_CHECK(index, fmt::format("No index on {} for {}", path, field));
 
-    auto const& table = expr.get_table();
+  if (auto record = lookup(*index, field, key))
+    return *record;
+  build_index(path, field, *index);
+  return lookup(*index, field, key).value_or(nullptr);
+}
+
+IndexStats Querier::index_stats(
+    std::string_view path, std::string_view field) const
+{
+  std::lock_guard lock(_mutex);
+  auto index = find_index(path, field);
+  AFCT_CHECK(index, fmt::format("No index on {} for {}", path, field));
+  return index->stats;
+}
+
+size_t Querier::IndexHash::operator()(Expr const& expr) const
+{
+  // numbers hash by value, as 1 and 1.0 are equal keys
+  if (expr.is_numeric())
+  {
+    auto value = expr.get_numeric();
+    return std::hash<double>()(value == 0.0 ? 0.0 : value);
+  }
+  return std::hash<Expr>()(expr);
+}
+
+Querier::Index* Querier::find_index(
+    std::string_view path, std::string_view field) const
+{
+  auto fields = _indexes.find(path);
+  if (fields == _indexes.end())
+    return nullptr;
+  auto it = fields->second.find(field);
+  if (it == fields->second.end())
+    return nullptr;
+
+  // rebuild if the list was replaced or resized underneath us
+  auto& index = it->second;
+  auto expr = find_view(path);
+  auto list = expr ? UnquotedList(*expr) : nullptr;
+  auto indexed = UnquotedList(index.list);
+  if (!index.stats.built || indexed != list ||
+      (list && list->size() != index.size))
+    build_index(path, field, index);
+
+  return &index;
+}
+
+void Querier::build_index(
+    std::string_view path, std::string_view field, Index& index) const
+{
+  auto start = std::chrono::steady_clock::now();
+
+  index = Index{};
+  auto expr = find_view(path);
+  auto list = expr ? UnquotedList(*expr) : nullptr;
+  AFCT_CHECK(list, fmt::format("List for {} not found", path));
+
+  auto key = ParseKey(field);
+  index.records.reserve(list->size());
+  for (size_t i = 0; i < list->size(); i++)
+  {
+    auto const& record = (*list)[i];
+    if (!record.is_table())
+      continue;
+
+    auto const& table = record.get_table();
     auto it = table.find(key);
     if (it == table.end())
-      return false;
+      continue;
 
-    expr = it->second;
+    auto type = it->second.get_type();
+    if (type == Type::Bool || type == Type::Double || type == Type::Int ||
+        type == Type::String || type == Type::Name)
+      index.records.emplace(it->second, i);
   }
+  index.list = *expr;
+  index.size = list->size();
 
-  result = expr;
-  return true;
+  // node holds the pair plus a next pointer and cached hash
+  auto node_bytes =
+      sizeof(std::pair<Expr const, size_t>) + 2 * sizeof(void*);
+  index.stats.built = true;
+  index.stats.entries = index.records.size();
+  index.stats.bytes = sizeof(index.records) +
+      index.records.bucket_count() * sizeof(void*) +
+      index.records.size() * node_bytes;
+  index.stats.build_time = std::chrono::steady_clock::now() - start;
+}
+
+std::optional<Expr const*> Querier::lookup(
+    Index const& index, std::string_view field, Expr const& key) const
+{
+  auto it = index.records.find(key);
+  if (it == index.records.end())
+    return nullptr;
+
+  auto const& list = *UnquotedList(index.list);
+  if (it->second >= list.size() || !list[it->second].is_table())
+    return std::nullopt;
+  auto const& record = list[it->second];
+  auto const& table = record.get_table();
+  auto value = table.find(ParseKey(field));
+  if (value == table.end() || value->second != key)
+    return std::nullopt;
+  return &record;
 }
 
 } // namespace afct
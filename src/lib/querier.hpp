@@ -1,17 +1,110 @@
 #pragma once
 
 #include "expr.hpp"
+#include "image.hpp"
 #include "util.hpp"
+#include <chrono>
 #include <fmt/format.h>
 #include <fmt/ostream.h>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <unordered_map>
 
 namespace afct {
 
+// views borrow from the querier's root and stay valid while it is unchanged
+using TableView = std::ranges::ref_view<Table const>;
+using KeysView = std::ranges::keys_view<TableView>;
+using ValuesView = std::ranges::values_view<TableView>;
+
+struct PathSegment
+{
+  enum class Kind
+  {
+    Key, // table key or list index
+    Wildcard, // *
+    Descend // **
+  };
+
+  Kind kind;
+  Expr key;
+};
+
+using Path = std::vector<PathSegment>;
+
+Path ParsePath(std::string_view path);
+
+// depth-first over the matches of a path, yielding lazily
+class QueryIterator
+{
+public:
+  using value_type = Expr;
+  using difference_type = std::ptrdiff_t;
+  using reference = Expr const&;
+  using pointer = Expr const*;
+  using iterator_concept = std::input_iterator_tag;
+
+  QueryIterator() = default;
+  QueryIterator(std::shared_ptr<Path const> path, Expr const* root);
+
+  Expr const& operator*() const;
+  Expr const* operator->() const;
+  QueryIterator& operator++();
+  void operator++(int);
+  bool operator==(std::default_sentinel_t) const;
+
+private:
+  struct Frame
+  {
+    Expr const* expr;
+    size_t segment;
+    size_t index{0};
+    Table::const_iterator it{};
+    bool started{false};
+  };
+
+  void advance();
+
+  std::shared_ptr<Path const> _path;
+  std::vector<Frame> _stack;
+  Expr const* _current{nullptr};
+};
+
+class QueryRange
+{
+public:
+  QueryRange(Path path, Expr const* root);
+
+  QueryIterator begin() const;
+  std::default_sentinel_t end() const;
+
+private:
+  std::shared_ptr<Path const> _path;
+  Expr const* _root;
+};
+
+struct IndexStats
+{
+  bool built{false};
+  size_t entries{0};
+  size_t bytes{0};
+  std::chrono::nanoseconds build_time{0};
+};
+
 class Querier
 {
 public:
   Querier();
   explicit Querier(Expr expr);
+  // reads in place from the image, decoding only the values returned; the
+  // view and index methods need an in-memory root
+  explicit Querier(std::shared_ptr<Image const> image);
 
   bool get_list(std::string const& path, std::vector<Expr>& result) const;
   std::vector<Expr> get_list(std::string const& path) const;
@@ -20,14 +113,65 @@ public:
   template<class T>
   T get(std::string const& path) const;
 
+  Expr const* find_view(std::string_view path) const;
+  Expr const& get_view(std::string_view path) const;
+  bool get_list_view(
+      std::string_view path, std::span<Expr const>& result) const;
+  std::span<Expr const> get_list_view(std::string_view path) const;
+  TableView get_table_view(std::string_view path) const;
+  KeysView get_keys(std::string_view path) const;
+  ValuesView get_values(std::string_view path) const;
+  QueryRange query(std::string_view path) const;
+  std::optional<ImageView> find_image_view(std::string_view path) const;
+
+  void set_root(Expr expr);
+  // indexes a list of tables at path by field, built on first find_by;
+  // call again after changing the field of a record in place
+  void index(std::string path, std::string field);
+  // safe to call from several threads, unlike set_root and index
+  Expr const* find_by(
+      std::string_view path, std::string_view field, Expr const& key) const;
+  IndexStats index_stats(std::string_view path, std::string_view field) const;
+
 private:
+  struct IndexHash
+  {
+    size_t operator()(Expr const& expr) const;
+  };
+
+  // keyed on copies of the field values, each mapped to its record's
+  // position, which lookups check again in case the record was replaced
+  struct Index
+  {
+    std::unordered_map<Expr, size_t, IndexHash> records;
+    // keeps the indexed list alive
+    Expr list;
+    size_t size{0};
+    IndexStats stats;
+  };
+
+  using Indexes = std::map<
+      std::string,
+      std::map<std::string, Index, std::less<>>,
+      std::less<>>;
+
+  Index* find_index(std::string_view path, std::string_view field) const;
+  void build_index(
+      std::string_view path, std::string_view field, Index& index) const;
+  // the record, null when none matches, or nullopt when the index is stale
+  std::optional<Expr const*> lookup(
+      Index const& index, std::string_view field, Expr const& key) const;
+
   template<class T>
   bool get(Expr const& value, T& result) const;
   template<class T>
   bool get_int(Expr const& value, T& result) const;
-  bool find(std::vector<std::string> const& elements, Expr& result) const;
 
   Expr _root;
+  std::shared_ptr<Image const> _image;
+  // built and rebuilt by const lookups
+  mutable std::mutex _mutex;
+  mutable Indexes _indexes;
 };
 
 } // namespace afct
@@ -37,11 +181,18 @@ namespace afct {
 template<class T>
 bool Querier::get(std::string const& path, T& result) const
 {
-  auto elements = Split("/", path);
-  Expr expr;
-  if (!find(std::move(elements), expr))
+  if (_image)
+  {
+    auto view = find_image_view(path);
+    if (!view)
+      return false;
+    return get<T>(view->to_expr(), result);
+  }
+
+  auto expr = find_view(path);
+  if (!expr)
     return false;
-  return get<T>(expr, result);
+  return get<T>(*expr, result);
 }
 
 template<class T>
@@ -0,0 +1,228 @@
+#include "reload.hpp"
+
+#include "cache.hpp"
+#include "eval.hpp"
+#include "util.hpp"
+#include <fmt/format.h>
+#include <fstream>
+
+namespace afct {
+
+namespace {
+
+void CollectNames(Expr const& expr, std::unordered_set<std::string>& names)
+{
+  if (expr.is_name())
+  {
+    names.insert(expr.get_name());
+  }
+  else if (expr.is_list() && !IsQuote(expr))
+  {
+    for (auto const& element : expr.get_list())
+      CollectNames(element, names);
+  }
+  else if (expr.is_table())
+  {
+    for (auto const& [key, value] : expr.get_table())
+    {
+      CollectNames(key, names);
+      CollectNames(value, names);
+    }
+  }
+}
+
+bool IsDefine(Expr const& expr)
+{
+  if (!expr.is_list())
+    return false;
+  auto const& list = expr.get_list();
+  return list.size() == 3 && list[0].is_name() &&
+      list[0].get_name() == "define" && list[1].is_name();
+}
+
+// plain forms are remembered by their printed text, as lists aren't hashable
+std::string Key(Expr const& expr)
+{
+  fmt::memory_buffer buffer;
+  Format(buffer, expr);
+  return fmt::to_string(buffer);
+}
+
+bool IsBegin(Expr const& expr)
+{
+  return expr.is_list() && expr.get_list().size() > 1 &&
+      expr.get_list()[0].is_name() && expr.get_list()[0].get_name() == "begin";
+}
+
+} // namespace
+
+Reloader::Reloader(std::filesystem::path path, std::shared_ptr<Env> env)
+  : _path(std::move(path)), _env(std::move(env))
+{}
+
+bool Reloader::stale() const
+{
+  std::error_code error;
+  auto time = std::filesystem::last_write_time(_path, error);
+  return !error && time != _loaded;
+}
+
+std::vector<std::string> Reloader::reload()
+{
+  std::error_code error;
+  auto time = std::filesystem::last_write_time(_path, error);
+  auto file = std::ifstream(_path);
+  AFCT_CHECK(file.good(), fmt::format("Failed to open {}", _path.string()));
+  std::string input(
+      (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  // a failed load is retried on the next change, not straight away
+  if (!error)
+    _loaded = time;
+  return update(ParseCache::Default().parse(std::move(input)));
+}
+
+std::vector<std::string> Reloader::update(Expr program)
+{
+  std::vector<Form> forms;
+  auto add = [&](Expr const& expr) {
+    Form form{expr, std::nullopt, {}};
+    if (IsDefine(expr))
+    {
+      form.name = expr.get_list()[1].get_name();
+      CollectNames(expr.get_list()[2], form.uses);
+    }
+    else
+    {
+      CollectNames(expr, form.uses);
+    }
+    forms.push_back(std::move(form));
+  };
+  if (IsBegin(program))
+  {
+    auto const& list = program.get_list();
+    for (size_t i = 1; i < list.size(); i++)
+      add(list[i]);
+  }
+  else
+  {
+    add(program);
+  }
+
+  // changed names spread to every form that mentions them, transitively
+  std::unordered_map<std::string, std::vector<size_t>> users;
+  for (size_t i = 0; i < forms.size(); i++)
+  {
+    for (auto const& use : forms[i].uses)
+      users[use].push_back(i);
+  }
+
+  std::vector<bool> dirty(forms.size(), false);
+  std::vector<std::string> changed;
+  std::unordered_set<std::string> defined;
+  std::unordered_set<std::string> present;
+  for (size_t i = 0; i < forms.size(); i++)
+  {
+    auto const& form = forms[i];
+    if (!form.name)
+    {
+      auto key = Key(form.expr);
+      dirty[i] = !_evaluated.contains(key);
+      present.insert(std::move(key));
+      continue;
+    }
+    defined.insert(*form.name);
+    auto it = _defines.find(*form.name);
+    if (it == _defines.end() || it->second != form.expr)
+    {
+      dirty[i] = true;
+      changed.push_back(*form.name);
+    }
+  }
+  for (auto const& [name, expr] : _defines)
+  {
+    if (!defined.contains(name))
+      changed.push_back(name);
+  }
+
+  // a define changes its name, a plain form any defined name it mentions,
+  // as set! does to a table
+  std::unordered_set<std::string> seen(changed.begin(), changed.end());
+  auto spread = [&](size_t i) {
+    if (forms[i].name)
+    {
+      if (seen.insert(*forms[i].name).second)
+        changed.push_back(*forms[i].name);
+      return;
+    }
+    for (auto const& use : forms[i].uses)
+    {
+      if (defined.contains(use) && seen.insert(use).second)
+        changed.push_back(use);
+    }
+  };
+  for (size_t i = 0; i < forms.size(); i++)
+  {
+    if (dirty[i] && !forms[i].name)
+      spread(i);
+  }
+  while (!changed.empty())
+  {
+    auto name = std::move(changed.back());
+    changed.pop_back();
+    auto it = users.find(name);
+    if (it == users.end())
+      continue;
+    for (auto i : it->second)
+    {
+      if (dirty[i])
+        continue;
+      dirty[i] = true;
+      spread(i);
+    }
+  }
+
+  std::erase_if(_defines, [&](auto const& pair) {
+    return !defined.contains(pair.first);
+  });
+  std::erase_if(
+      _evaluated, [&](auto const& expr) { return !present.contains(expr); });
+
+  std::vector<std::string> evaluated;
+  for (size_t i = 0; i < forms.size(); i++)
+  {
+    if (!dirty[i])
+      continue;
+
+    auto const& form = forms[i];
+    try
+    {
+      Eval(form.expr, _env);
+    }
+    catch (...)
+    {
+      // forgotten, so the next reload runs them again
+      for (auto j = i; j < forms.size(); j++)
+      {
+        if (dirty[j] && forms[j].name)
+          _defines.erase(*forms[j].name);
+        else if (dirty[j])
+          _evaluated.erase(Key(forms[j].expr));
+      }
+      throw;
+    }
+
+    if (form.name)
+    {
+      _defines[*form.name] = form.expr;
+      evaluated.push_back(*form.name);
+    }
+    else
+    {
+      _evaluated.insert(Key(form.expr));
+    }
+  }
+  return evaluated;
+}
+
+} // namespace afct
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "env.hpp"
+#include "expr.hpp"
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace afct {
+
+// keeps a file's top-level forms, the elements of an outer begin, live in
+// env; a reload re-evaluates only the defines whose form changed and those
+// that mention a changed name, plus new or dependent plain forms, which in
+// turn count as changing every defined name they mention; names are
+// matched without regard to scope, so it may re-run too much but never
+// too little; defines removed from the file stay bound, and the side
+// effects of removed plain forms, such as a set!, persist
+class Reloader
+{
+public:
+  Reloader(std::filesystem::path path, std::shared_ptr<Env> env);
+
+  // whether the file changed since it was last read
+  bool stale() const;
+  // names of the defines evaluated, in file order; after a failure the
+  // forms not yet evaluated are retried by the next reload
+  std::vector<std::string> reload();
+  std::vector<std::string> update(Expr program);
+
+private:
+  struct Form
+  {
+    Expr expr;
+    std::optional<std::string> name;
+    std::unordered_set<std::string> uses;
+  };
+
+  std::filesystem::path _path;
+  std::shared_ptr<Env> _env;
+  std::optional<std::filesystem::file_time_type> _loaded;
+  // what each name was last defined from
+  std::unordered_map<std::string, Expr> _defines;
+  std::unordered_set<std::string> _evaluated;
+};
+
+} // namespace afct
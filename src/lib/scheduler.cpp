@@ -0,0 +1,180 @@
+#include "scheduler.hpp"
+
+#include "eval.hpp"
+#include "util.hpp"
+
+namespace afct {
+
+Script::Script(Expr expr, std::shared_ptr<Env> env)
+  : _fuel(std::make_shared<Fuel>())
+  , _task(EvalAsync(std::move(expr), std::move(env), _fuel.get()))
+{}
+
+bool Script::run(int64_t steps)
+{
+  AFCT_CHECK(!done(), "Script has already finished");
+
+  _fuel->refuel(steps);
+  if (!_started)
+  {
+    _started = true;
+    _task.resume();
+  }
+  else
+  {
+    auto preempted = _fuel->take_preempted();
+    AFCT_CHECK(preempted, "Script is suspended on I/O, not fuel");
+    preempted.resume();
+  }
+  return done();
+}
+
+bool Script::done() const
+{
+  return _started && _task.done();
+}
+
+uint64_t Script::steps() const
+{
+  return _fuel->used();
+}
+
+Fuel& Script::fuel()
+{
+  return *_fuel;
+}
+
+Expr Script::result()
+{
+  AFCT_CHECK(done(), "Script has not finished");
+  return _task.await_resume();
+}
+
+Scheduler::Scheduler(size_t threads, int64_t slice)
+  : _slice(slice)
+{
+  AFCT_CHECK(threads > 0 && slice > 0, "Expected threads and slice above 0");
+  for (size_t i = 0; i < threads; i++)
+    _threads.emplace_back([this] { work(); });
+}
+
+Scheduler::~Scheduler()
+{
+  {
+    std::lock_guard lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (auto& thread : _threads)
+    thread.join();
+
+  // nothing will run these again, so their waiters are told
+  auto error = std::make_exception_ptr(Exception("Scheduler stopped"));
+  for (auto& entry : _queue)
+    entry.done(Expr{}, error);
+  for (auto& [script, entry] : _parked)
+    entry.done(Expr{}, error);
+}
+
+std::shared_ptr<Script> Scheduler::submit(
+    Expr expr,
+    std::shared_ptr<Env> env,
+    Done done,
+    unsigned weight,
+    uint64_t limit)
+{
+  auto script = std::make_shared<Script>(std::move(expr), std::move(env));
+  std::optional<uint64_t> budget;
+  if (limit > 0)
+    budget = limit;
+  {
+    std::lock_guard lock(_mutex);
+    _queue.push_back({script, std::move(done), std::max(weight, 1u), budget});
+  }
+  _wake.notify_one();
+  return script;
+}
+
+void Scheduler::refuel(std::shared_ptr<Script> const& script, uint64_t steps)
+{
+  {
+    std::lock_guard lock(_mutex);
+    auto it = _parked.find(script.get());
+    AFCT_CHECK(it != _parked.end(), "Expected a parked script to refuel");
+    auto entry = std::move(it->second);
+    _parked.erase(it);
+    entry.budget = steps;
+    _queue.push_back(std::move(entry));
+  }
+  _wake.notify_one();
+}
+
+void Scheduler::wait()
+{
+  std::unique_lock lock(_mutex);
+  _idle.wait(lock, [this] { return _queue.empty() && _running == 0; });
+}
+
+size_t Scheduler::parked() const
+{
+  std::lock_guard lock(_mutex);
+  return _parked.size();
+}
+
+void Scheduler::work()
+{
+  while (true)
+  {
+    Entry entry;
+    {
+      std::unique_lock lock(_mutex);
+      _wake.wait(lock, [this] { return _stop || !_queue.empty(); });
+      if (_stop)
+        return;
+      entry = std::move(_queue.front());
+      _queue.pop_front();
+      _running++;
+    }
+
+    auto steps = static_cast<uint64_t>(_slice) * entry.weight;
+    if (entry.budget)
+      steps = std::min(steps, *entry.budget);
+
+    auto& script = *entry.script;
+    auto before = script.steps();
+    if (entry.budget)
+      script.fuel().set_limit(before + *entry.budget);
+    auto finished = script.run(static_cast<int64_t>(steps));
+    if (entry.budget)
+      *entry.budget -= std::min(*entry.budget, script.steps() - before);
+
+    if (finished)
+    {
+      Expr result;
+      std::exception_ptr error;
+      try
+      {
+        result = script.result();
+      }
+      catch (...)
+      {
+        error = std::current_exception();
+      }
+      entry.done(std::move(result), error);
+    }
+
+    {
+      std::lock_guard lock(_mutex);
+      if (!finished && entry.budget == 0u)
+        _parked.emplace(entry.script.get(), std::move(entry));
+      else if (!finished)
+        _queue.push_back(std::move(entry));
+      _running--;
+      if (_queue.empty() && _running == 0)
+        _idle.notify_all();
+    }
+    _wake.notify_one();
+  }
+}
+
+} // namespace afct
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "async.hpp"
+#include "env.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace afct {
+
+// evaluation that runs in slices of a given number of steps, keeping its
+// state between them; resumable on any thread, one slice at a time
+class Script
+{
+public:
+  Script(Expr expr, std::shared_ptr<Env> env);
+
+  // true once the script has finished
+  bool run(int64_t steps);
+  bool done() const;
+  uint64_t steps() const;
+  // bounds for the steps taken inside builtins, which cannot be preempted
+  Fuel& fuel();
+  // rethrows the script's failure
+  Expr result();
+
+private:
+  std::shared_ptr<Fuel> _fuel;
+  AsyncExpr _task;
+  bool _started{false};
+};
+
+// time-slices scripts round robin over a fixed set of threads; a script of
+// weight w runs w slices per turn. Scripts still queued or parked when the
+// scheduler is destroyed are failed
+class Scheduler
+{
+public:
+  using Done = std::function<void(Expr, std::exception_ptr)>;
+
+  Scheduler(size_t threads, int64_t slice = 1000);
+  ~Scheduler();
+  Scheduler(Scheduler const&) = delete;
+  Scheduler& operator=(Scheduler const&) = delete;
+
+  // a script that uses up limit steps in total, when non-zero, is parked
+  // with its state intact until refuelled, or fails if it runs out inside
+  // a builtin
+  std::shared_ptr<Script> submit(
+      Expr expr,
+      std::shared_ptr<Env> env,
+      Done done,
+      unsigned weight = 1,
+      uint64_t limit = 0);
+  void refuel(std::shared_ptr<Script> const& script, uint64_t steps);
+  // blocks until every script has finished or been parked
+  void wait();
+  size_t parked() const;
+
+private:
+  struct Entry
+  {
+    std::shared_ptr<Script> script;
+    Done done;
+    unsigned weight;
+    // steps left before parking, absent when unlimited
+    std::optional<uint64_t> budget;
+  };
+
+  void work();
+
+  int64_t _slice;
+  mutable std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _idle;
+  std::deque<Entry> _queue;
+  std::unordered_map<Script*, Entry> _parked;
+  size_t _running{0};
+  bool _stop{false};
+  std::vector<std::thread> _threads;
+};
+
+} // namespace afct
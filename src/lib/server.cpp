@@ -0,0 +1,437 @@
+#include "server.hpp"
+
+#include "memory.hpp"
+#include "parse.hpp"
+#include "scheduler.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fmt/format.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+namespace afct {
+
+namespace {
+
+constexpr uint32_t kMaxMessage = 64 << 20;
+constexpr uint8_t kOk = 0;
+constexpr uint8_t kError = 1;
+constexpr std::chrono::milliseconds kSendTimeout{10'000};
+
+// false on a clean end of stream before the first byte
+bool ReadFull(int fd, char* data, size_t size)
+{
+  size_t done = 0;
+  while (done < size)
+  {
+    auto n = ::read(fd, data + done, size - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n == 0 && done == 0)
+      return false;
+    AFCT_CHECK(n > 0, "Connection closed mid-message");
+    done += n;
+  }
+  return true;
+}
+
+// waits up to kSendTimeout whenever a non-blocking fd is full, so a peer
+// that stops reading doesn't hold the sender for good
+void WriteFull(int fd, char const* data, size_t size)
+{
+  size_t done = 0;
+  while (done < size)
+  {
+    auto n = ::send(fd, data + done, size - done, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      pollfd out{fd, POLLOUT, 0};
+      auto ready = ::poll(&out, 1, kSendTimeout.count());
+      if (ready < 0 && errno == EINTR)
+        continue;
+      AFCT_CHECK(ready > 0, "Timed out sending");
+      continue;
+    }
+    AFCT_CHECK(n > 0, fmt::format("Failed to send: {}", strerror(errno)));
+    done += n;
+  }
+}
+
+void PutLength(std::string& out, uint32_t length)
+{
+  for (size_t i = 0; i < 4; i++)
+    out.push_back(static_cast<char>(length >> (8 * i)));
+}
+
+// false on a clean end of stream
+bool ReadMessage(int fd, std::string& message)
+{
+  char header[4];
+  if (!ReadFull(fd, header, sizeof(header)))
+    return false;
+
+  uint32_t length = 0;
+  for (size_t i = 0; i < 4; i++)
+    length |= static_cast<uint32_t>(static_cast<uint8_t>(header[i]))
+        << (8 * i);
+  AFCT_CHECK(
+      length <= kMaxMessage,
+      fmt::format("Message of {} bytes too long", length));
+  message.resize(length);
+  AFCT_CHECK(ReadFull(fd, message.data(), length), "Truncated message");
+  return true;
+}
+
+// appends what a non-blocking fd has to offer, up to one full message;
+// false once the peer has closed or failed
+bool ReadAvailable(int fd, std::string& buffer)
+{
+  char chunk[1 << 14];
+  while (buffer.size() < 4 + kMaxMessage)
+  {
+    auto n = ::read(fd, chunk, sizeof(chunk));
+    if (n > 0)
+      buffer.append(chunk, n);
+    else if (n < 0 && errno == EINTR)
+      continue;
+    else
+      return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+  return true;
+}
+
+// moves the first complete message out of buffer, if there is one
+bool TakeMessage(std::string& buffer, std::string& message)
+{
+  if (buffer.size() < 4)
+    return false;
+
+  uint32_t length = 0;
+  for (size_t i = 0; i < 4; i++)
+    length |= static_cast<uint32_t>(static_cast<uint8_t>(buffer[i]))
+        << (8 * i);
+  AFCT_CHECK(
+      length <= kMaxMessage,
+      fmt::format("Message of {} bytes too long", length));
+  if (buffer.size() - 4 < length)
+    return false;
+  message.assign(buffer, 4, length);
+  buffer.erase(0, 4 + length);
+  return true;
+}
+
+sockaddr_un Address(std::filesystem::path const& socket)
+{
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  AFCT_CHECK(
+      socket.native().size() < sizeof(address.sun_path),
+      fmt::format("Socket path {} too long", socket.string()));
+  std::strcpy(address.sun_path, socket.c_str());
+  return address;
+}
+
+} // namespace
+
+Server::Server(std::filesystem::path socket, ServerOptions options)
+  : _socket(std::move(socket))
+  , _options(std::move(options))
+  , _contexts(0, 64, _options.base)
+{
+  auto address = Address(_socket);
+  auto generic = reinterpret_cast<sockaddr*>(&address);
+
+  // a socket left behind by a server that died is replaced, a live one is not
+  if (std::filesystem::is_socket(_socket))
+  {
+    auto probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    AFCT_CHECK(probe >= 0, "Failed to create socket");
+    auto live = ::connect(probe, generic, sizeof(address)) == 0;
+    ::close(probe);
+    AFCT_CHECK(
+        !live,
+        fmt::format("A server is already listening on {}", _socket.string()));
+    ::unlink(_socket.c_str());
+  }
+
+  _listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  AFCT_CHECK(_listener >= 0, "Failed to create socket");
+  if (::bind(_listener, generic, sizeof(address)) != 0 ||
+      ::listen(_listener, SOMAXCONN) != 0)
+  {
+    ::close(_listener);
+    AFCT_ERROR(fmt::format(
+        "Failed to listen on {}: {}", _socket.string(), strerror(errno)));
+  }
+
+  _wake = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (_wake < 0)
+  {
+    auto error = errno;
+    ::close(_listener);
+    ::unlink(_socket.c_str());
+    AFCT_ERROR(fmt::format("Failed to create eventfd: {}", strerror(error)));
+  }
+}
+
+Server::~Server()
+{
+  ::close(_listener);
+  ::close(_wake);
+  ::unlink(_socket.c_str());
+}
+
+void Server::run()
+{
+  {
+    ThreadPool pool(
+        _options.threads ? _options.threads
+                         : std::max(1u, std::thread::hardware_concurrency()));
+    // the listener, the wake fd, then the idle connections, whose partial
+    // requests are buffered here so a stalled client holds no worker
+    std::vector<pollfd> fds = {{_listener, POLLIN, 0}, {_wake, POLLIN, 0}};
+    std::unordered_map<int, std::string> buffers;
+    auto drop = [&](int fd) {
+      buffers.erase(fd);
+      ::close(fd);
+    };
+    // hands a complete request to the pool, false if there is none yet
+    auto dispatch = [&](int fd) {
+      std::string request;
+      if (!TakeMessage(buffers[fd], request))
+        return false;
+      {
+        std::lock_guard lock(_mutex);
+        _busy.insert(fd);
+      }
+      pool.submit([this, fd, request = std::move(request)]() mutable {
+        serve(fd, std::move(request));
+      });
+      return true;
+    };
+
+    while (true)
+    {
+      if (::poll(fds.data(), fds.size(), -1) < 0)
+      {
+        AFCT_CHECK(errno == EINTR, "Failed to poll server socket");
+        continue;
+      }
+
+      if (fds[1].revents)
+      {
+        uint64_t count;
+        [[maybe_unused]] auto n = ::read(_wake, &count, sizeof(count));
+        if (_stopping)
+          break;
+      }
+
+      // a connection leaves the poll set while its request is answered
+      for (size_t i = 2; i < fds.size();)
+      {
+        auto fd = fds[i].fd;
+        if (!fds[i].revents)
+        {
+          i++;
+          continue;
+        }
+
+        auto open = ReadAvailable(fd, buffers[fd]);
+        bool dispatched = false;
+        try
+        {
+          dispatched = dispatch(fd);
+        }
+        catch (Exception const&)
+        {
+          open = false;
+        }
+        if (open && !dispatched)
+        {
+          i++;
+          continue;
+        }
+
+        fds[i] = fds.back();
+        fds.pop_back();
+        if (!dispatched)
+          drop(fd);
+      }
+
+      std::vector<std::pair<int, bool>> returned;
+      {
+        std::lock_guard lock(_mutex);
+        returned.swap(_returned);
+      }
+      for (auto [fd, open] : returned)
+      {
+        bool dispatched = false;
+        try
+        {
+          // a request sent before the last was answered
+          dispatched = open && dispatch(fd);
+        }
+        catch (Exception const&)
+        {
+          open = false;
+        }
+        if (!open)
+          drop(fd);
+        else if (!dispatched)
+          fds.push_back({fd, POLLIN, 0});
+      }
+
+      while (fds[0].revents)
+      {
+        auto fd = ::accept4(
+            _listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0)
+          break;
+        fds.push_back({fd, POLLIN, 0});
+      }
+    }
+
+    // refuses connections still in the backlog, closes idle ones and ends
+    // the replies of busy ones, whose requests are cancelled; then the
+    // pool drains
+    for (int fd; (fd = ::accept(_listener, nullptr, nullptr)) >= 0;)
+      ::close(fd);
+    for (size_t i = 2; i < fds.size(); i++)
+      ::close(fds[i].fd);
+    std::lock_guard lock(_mutex);
+    for (auto fd : _busy)
+      ::shutdown(fd, SHUT_RDWR);
+  }
+
+  for (auto [fd, open] : _returned)
+    ::close(fd);
+  _returned.clear();
+  _stopping = false;
+  uint64_t count;
+  while (::read(_wake, &count, sizeof(count)) > 0)
+  {}
+}
+
+void Server::stop()
+{
+  _stopping = true;
+  uint64_t one = 1;
+  [[maybe_unused]] auto n = ::write(_wake, &one, sizeof(one));
+}
+
+void Server::serve(int fd, std::string request)
+{
+  bool open = false;
+  try
+  {
+    bool ok = false;
+    auto result = eval(std::move(request), ok);
+    std::string reply(1, static_cast<char>(ok ? kOk : kError));
+    PutLength(reply, result.size());
+    reply += result;
+    WriteFull(fd, reply.data(), reply.size());
+    open = true;
+  }
+  catch (Exception const&)
+  {
+    // a broken connection only ends itself
+  }
+
+  {
+    std::lock_guard lock(_mutex);
+    _busy.erase(fd);
+    _returned.emplace_back(fd, open && !_stopping);
+  }
+  uint64_t one = 1;
+  [[maybe_unused]] auto n = ::write(_wake, &one, sizeof(one));
+}
+
+std::string Server::eval(std::string source, bool& ok)
+{
+  auto lease = _contexts.acquire();
+  std::shared_ptr<MemoryAccount> account;
+  if (_options.memory_limit)
+    account = std::make_shared<MemoryAccount>(_options.memory_limit);
+  MemoryScope scope(account);
+  ReadOnlyTables::Scope read_only(_contexts.read_only());
+
+  auto timeout = _options.timeout;
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  auto timed_out = [&] {
+    return timeout.count() && std::chrono::steady_clock::now() >= deadline;
+  };
+  try
+  {
+    Script script(Parse(std::move(source)), lease.env());
+    // builtins that call back into the script can't be preempted, so
+    // the fuel stops them itself
+    if (timeout.count())
+      script.fuel().set_deadline(deadline);
+    script.fuel().set_cancel(&_stopping);
+    while (!script.run(_options.slice))
+    {
+      AFCT_CHECK(!timed_out(), "Timed out");
+      AFCT_CHECK(!_stopping, "Cancelled");
+    }
+
+    fmt::memory_buffer buffer;
+    Format(buffer, script.result());
+    ok = true;
+    return fmt::to_string(buffer);
+  }
+  catch (std::exception const& e)
+  {
+    ok = false;
+    if (timed_out())
+      return fmt::format("Request timed out after {} ms", timeout.count());
+    if (_stopping)
+      return "Server is stopping";
+    return e.what();
+  }
+}
+
+Client::Client(std::filesystem::path const& socket)
+{
+  auto address = Address(socket);
+  auto generic = reinterpret_cast<sockaddr*>(&address);
+  _fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  AFCT_CHECK(_fd >= 0, "Failed to create socket");
+  if (::connect(_fd, generic, sizeof(address)) != 0)
+  {
+    ::close(_fd);
+    AFCT_ERROR(fmt::format(
+        "Failed to connect to {}: {}", socket.string(), strerror(errno)));
+  }
+}
+
+Client::~Client()
+{
+  ::close(_fd);
+}
+
+std::string Client::eval(std::string const& source)
+{
+  AFCT_CHECK(source.size() <= kMaxMessage, "Request too long");
+  std::string request;
+  PutLength(request, source.size());
+  request += source;
+  WriteFull(_fd, request.data(), request.size());
+
+  char status;
+  AFCT_CHECK(ReadFull(_fd, &status, 1), "Server closed the connection");
+  std::string result;
+  AFCT_CHECK(ReadMessage(_fd, result), "Server closed the connection");
+  AFCT_CHECK(status == kOk, result);
+  return result;
+}
+
+} // namespace afct
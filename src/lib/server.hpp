@@ -0,0 +1,86 @@
+#pragma once
+
+#include "context.hpp"
+#include "env.hpp"
+#include "pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace afct {
+
+struct ServerOptions
+{
+  // 0 for the hardware concurrency
+  size_t threads{0};
+  // per request, 0 for none; enforced inside builtins too
+  std::chrono::milliseconds timeout{0};
+  int64_t slice{1000};
+  // bytes per request, 0 for none
+  size_t memory_limit{0};
+  // library env under every request, the builtins when null; must not be
+  // changed while serving, and set! refuses the tables in it
+  std::shared_ptr<Env> base;
+};
+
+// answers eval requests over a Unix socket; a request is a 4-byte little
+// endian length and the source, the reply a status byte, 0 for success,
+// then a length and the printed result or error; each request gets a
+// fresh env over the shared base and a pool worker only while it runs,
+// idle connections wait in the accepting thread's poll set
+class Server
+{
+public:
+  Server(std::filesystem::path socket, ServerOptions options = {});
+  ~Server();
+  Server(Server const&) = delete;
+  Server& operator=(Server const&) = delete;
+
+  // serves until stop is called, which cancels requests in flight, then
+  // closes every connection
+  void run();
+  // safe from any thread or a signal handler
+  void stop();
+
+private:
+  // answers one request, then hands the connection back to run, which
+  // closes it unless it is still open
+  void serve(int fd, std::string request);
+  std::string eval(std::string source, bool& ok);
+
+  std::filesystem::path _socket;
+  ServerOptions _options;
+  ContextPool _contexts;
+  int _listener{-1};
+  // signalled by stop and by connections handed back
+  int _wake{-1};
+  std::atomic<bool> _stopping{false};
+  std::mutex _mutex;
+  // connections with a request in flight, and those answered, with
+  // whether they are still open
+  std::unordered_set<int> _busy;
+  std::vector<std::pair<int, bool>> _returned;
+};
+
+// one connection to a Server, requests answered in order
+class Client
+{
+public:
+  explicit Client(std::filesystem::path const& socket);
+  ~Client();
+  Client(Client const&) = delete;
+  Client& operator=(Client const&) = delete;
+
+  // the printed result, throwing the server's error as an Exception
+  std::string eval(std::string const& source);
+
+private:
+  int _fd{-1};
+};
+
+} // namespace afct
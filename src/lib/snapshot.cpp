@@ -0,0 +1,447 @@
+#include "snapshot.hpp"
+
+#include "function.hpp"
+#include "prelude.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace afct {
+
+namespace {
+
+// header is magic, version, root env, env table offset, env count; nodes
+// are 8-byte aligned words led by their type, as in expression images,
+// with lambdas holding params, body and env, and builtins their name;
+// lists and tables come before their elements, so cycles are kept
+constexpr uint64_t kMagic = 0x50414e53'54434641; // "AFCTSNAP"
+constexpr uint64_t kVersion = 1;
+constexpr uint64_t kHeaderSize = 40;
+
+// envs are referred to by 0 for none, 1 for the builtins, else index + 2
+constexpr uint64_t kNoEnv = 0;
+constexpr uint64_t kBuiltinsEnv = 1;
+constexpr uint64_t kFirstEnv = 2;
+
+class Writer
+{
+public:
+  std::string write(std::shared_ptr<Env> const& root_env)
+  {
+    for (size_t i = 0; i < kHeaderSize / 8; i++)
+      put(0);
+
+    auto root = env(root_env);
+    std::vector<uint64_t> offsets;
+    // envs met while writing values are queued, so no recursion through them
+    for (size_t i = 0; i < _pending.size(); i++)
+    {
+      auto const& current = *_pending[i];
+      auto outer = env(current.outer());
+      std::vector<std::pair<uint64_t, uint64_t>> entries;
+      for (auto const& [name, value] : current.bindings())
+        entries.emplace_back(text(Type::Name, name), write(value));
+
+      offsets.push_back(_out.size());
+      put(outer);
+      put(entries.size());
+      for (auto [name, value] : entries)
+      {
+        put(name);
+        put(value);
+      }
+    }
+
+    auto table = _out.size();
+    for (auto offset : offsets)
+      put(offset);
+
+    set(0, kMagic);
+    set(8, kVersion);
+    set(16, root);
+    set(24, table);
+    set(32, offsets.size());
+    return std::move(_out);
+  }
+
+private:
+  uint64_t env(std::shared_ptr<Env> const& env)
+  {
+    if (!env)
+      return kNoEnv;
+    if (env == Builtins())
+      return kBuiltinsEnv;
+
+    auto [it, inserted] = _envs.emplace(env.get(), _pending.size());
+    if (inserted)
+      _pending.push_back(env);
+    return kFirstEnv + it->second;
+  }
+
+  uint64_t write(Expr const& expr)
+  {
+    auto type = expr.get_type();
+    switch (type)
+    {
+    case Type::Null: return node(type);
+    case Type::Bool: return node(type, expr.get_bool());
+    case Type::Double:
+    {
+      uint64_t bits;
+      auto d = expr.get_double();
+      std::memcpy(&bits, &d, sizeof(bits));
+      return node(type, bits);
+    }
+    case Type::Int: return node(type, expr.get_int());
+    case Type::String: return text(type, expr.get_string());
+    case Type::Name: return text(type, expr.get_name());
+    case Type::Lambda:
+    {
+      auto const& lambda = expr.get_lambda();
+      if (auto it = _nodes.find(&lambda); it != _nodes.end())
+        return it->second;
+
+      auto params = write(lambda.params);
+      auto body = write(lambda.body);
+      auto env_ref = env(lambda.env);
+      auto offset = node(type, params);
+      put(body);
+      put(env_ref);
+      return _nodes[&lambda] = offset;
+    }
+    case Type::Builtin:
+    {
+      auto const& builtin = expr.get_builtin();
+      auto found = Builtins()->find(builtin.name);
+      AFCT_CHECK(
+          found && found->get_builtin().function == builtin.function,
+          fmt::format("{} not storable in snapshot", builtin.name));
+      return text(type, builtin.name);
+    }
+    case Type::List:
+    {
+      auto const& list = expr.get_list();
+      if (auto it = _nodes.find(&list); it != _nodes.end())
+        return it->second;
+      return write(list, &list);
+    }
+    case Type::Table:
+    {
+      auto const& table = expr.get_table();
+      if (auto it = _nodes.find(&table); it != _nodes.end())
+        return it->second;
+
+      // registered before its entries, which may lead back to it
+      auto offset = node(type, table.size());
+      _nodes[&table] = offset;
+      auto slot = slots(2 * table.size());
+      for (auto const& [key, value] : table)
+      {
+        set(slot, write(key));
+        set(slot + 8, write(value));
+        slot += 16;
+      }
+      return offset;
+    }
+    }
+    AFCT_ERROR(fmt::format("{} not storable in snapshot", expr));
+  }
+
+  // a shared list is registered under shared before its elements
+  uint64_t write(List const& list, void const* shared = nullptr)
+  {
+    auto offset = node(Type::List, list.size());
+    if (shared)
+      _nodes[shared] = offset;
+    auto slot = slots(list.size());
+    for (auto const& element : list)
+    {
+      set(slot, write(element));
+      slot += 8;
+    }
+    return offset;
+  }
+
+  // zeroed words filled in once what they point to is written
+  uint64_t slots(size_t count)
+  {
+    auto offset = _out.size();
+    _out.resize(offset + 8 * count, '\0');
+    return offset;
+  }
+
+  uint64_t node(Type type)
+  {
+    auto offset = _out.size();
+    put(static_cast<uint64_t>(type));
+    return offset;
+  }
+
+  uint64_t node(Type type, uint64_t payload)
+  {
+    auto offset = node(type);
+    put(payload);
+    return offset;
+  }
+
+  uint64_t text(Type type, std::string const& value)
+  {
+    auto offset = node(type, value.size());
+    _out.append(value);
+    _out.resize((_out.size() + 7) / 8 * 8, '\0');
+    return offset;
+  }
+
+  void put(uint64_t word)
+  {
+    for (size_t i = 0; i < 8; i++)
+      _out.push_back(static_cast<char>(word >> (8 * i)));
+  }
+
+  void set(size_t offset, uint64_t word)
+  {
+    for (size_t i = 0; i < 8; i++)
+      _out[offset + i] = static_cast<char>(word >> (8 * i));
+  }
+
+  std::string _out;
+  std::unordered_map<void const*, uint64_t> _nodes;
+  std::unordered_map<Env const*, uint64_t> _envs;
+  std::vector<std::shared_ptr<Env>> _pending;
+};
+
+// turns offsets into live objects, each shared node made once
+class Reader
+{
+public:
+  explicit Reader(std::string_view data) : _data(data)
+  {
+    AFCT_CHECK(
+        _data.size() >= kHeaderSize && word(0) == kMagic,
+        "Not an env snapshot");
+    AFCT_CHECK(
+        word(8) == kVersion,
+        fmt::format("Unsupported snapshot version {}", word(8)));
+    _envs.resize(word(32));
+    _opening.resize(_envs.size());
+  }
+
+  std::shared_ptr<Env> read()
+  {
+    return env(word(16));
+  }
+
+private:
+  std::shared_ptr<Env> env(uint64_t ref)
+  {
+    if (ref == kNoEnv)
+      return nullptr;
+    if (ref == kBuiltinsEnv)
+      return Builtins();
+
+    auto index = ref - kFirstEnv;
+    AFCT_CHECK(index < _envs.size(), "Bad env in snapshot");
+    if (_envs[index])
+      return _envs[index];
+
+    AFCT_CHECK(!_opening[index], "Env is its own outer in snapshot");
+    _opening[index] = true;
+    auto offset = word(word(24) + 8 * index);
+    // registered before its bindings, which may close over it
+    auto result = Env::Make(env(word(offset)));
+    _envs[index] = result;
+    auto count = word(offset + 8);
+    for (size_t i = 0; i < count; i++)
+    {
+      auto entry = offset + 16 + 16 * i;
+      result->set(
+          std::string(text(word(entry), Type::Name)),
+          node(word(entry + 8)));
+    }
+    return result;
+  }
+
+  Expr node(uint64_t offset)
+  {
+    auto type = word(offset);
+    switch (static_cast<Type>(type))
+    {
+    case Type::Null: return Expr{};
+    case Type::Bool: return Expr{word(offset + 8) != 0};
+    case Type::Double:
+    {
+      auto bits = word(offset + 8);
+      double d;
+      std::memcpy(&d, &bits, sizeof(d));
+      return Expr{d};
+    }
+    case Type::Int: return Expr{static_cast<int64_t>(word(offset + 8))};
+    case Type::String:
+      return Expr{String{std::string(text(offset, Type::String))}};
+    case Type::Name: return Expr{Name{std::string(text(offset, Type::Name))}};
+    case Type::Builtin:
+    {
+      auto name = std::string(text(offset, Type::Builtin));
+      auto found = Builtins()->find(name);
+      AFCT_CHECK(
+          found && found->is_builtin(),
+          fmt::format("Unknown builtin {} in snapshot", name));
+      return *found;
+    }
+    default: break;
+    }
+
+    if (auto it = _nodes.find(offset); it != _nodes.end())
+      return it->second;
+
+    Expr result;
+    switch (static_cast<Type>(type))
+    {
+    case Type::Lambda:
+    {
+      // its params and body are written before it, so leading back to it
+      // from them only comes from a corrupt snapshot
+      AFCT_CHECK(_building.insert(offset).second, "Bad lambda in snapshot");
+      auto params = node(word(offset + 8));
+      auto body = node(word(offset + 16));
+      _building.erase(offset);
+      AFCT_CHECK(params.is_list(), "Bad lambda in snapshot");
+
+      // registered before its env, which may bind it
+      result = Expr{Lambda{params.get_list(), std::move(body), nullptr}};
+      _nodes[offset] = result;
+      result.get_lambda().env = env(word(offset + 24));
+      return result;
+    }
+    // containers are registered before their elements, which may lead
+    // back to them
+    case Type::List:
+    {
+      result = Expr{List{}};
+      _nodes[offset] = result;
+      auto& list = result.get_list();
+      auto size = word(offset + 8);
+      list.reserve(std::min<uint64_t>(size, _data.size() / 8));
+      for (size_t i = 0; i < size; i++)
+        list.push_back(node(word(offset + 16 + 8 * i)));
+      return result;
+    }
+    case Type::Table:
+    {
+      result = Expr{Table{}};
+      _nodes[offset] = result;
+      auto& table = result.get_table();
+      auto size = word(offset + 8);
+      for (size_t i = 0; i < size; i++)
+      {
+        auto entry = offset + 16 + 16 * i;
+        auto key = node(word(entry));
+        auto value = node(word(entry + 8));
+        table[std::move(key)] = std::move(value);
+      }
+      return result;
+    }
+    default: AFCT_ERROR(fmt::format("Bad node type {} in snapshot", type));
+    }
+    return _nodes[offset] = result;
+  }
+
+  std::string_view text(uint64_t offset, Type type)
+  {
+    AFCT_CHECK(
+        word(offset) == static_cast<uint64_t>(type),
+        fmt::format("Bad node type {} in snapshot", word(offset)));
+    auto size = word(offset + 8);
+    AFCT_CHECK(
+        size <= _data.size() && offset + 16 <= _data.size() - size,
+        "Offset out of range in snapshot");
+    return _data.substr(offset + 16, size);
+  }
+
+  uint64_t word(uint64_t offset) const
+  {
+    AFCT_CHECK(
+        offset % 8 == 0 && offset + 8 <= _data.size() && offset + 8 > offset,
+        "Offset out of range in snapshot");
+    uint64_t result = 0;
+    for (size_t i = 0; i < 8; i++)
+      result |= static_cast<uint64_t>(static_cast<uint8_t>(_data[offset + i]))
+          << (8 * i);
+    return result;
+  }
+
+  std::string_view _data;
+  std::vector<std::shared_ptr<Env>> _envs;
+  std::vector<bool> _opening;
+  std::unordered_set<uint64_t> _building;
+  std::unordered_map<uint64_t, Expr> _nodes;
+};
+
+} // namespace
+
+std::string EncodeSnapshot(std::shared_ptr<Env> const& env)
+{
+  return Writer().write(env);
+}
+
+void WriteSnapshot(
+    std::shared_ptr<Env> const& env, std::filesystem::path const& path)
+{
+  auto data = EncodeSnapshot(env);
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  AFCT_CHECK(file.good(), fmt::format("Failed to open {}", path.string()));
+  file.write(data.data(), data.size());
+  AFCT_CHECK(file.good(), fmt::format("Failed to write {}", path.string()));
+}
+
+std::shared_ptr<Env> DecodeSnapshot(std::string_view data)
+{
+  return Reader(data).read();
+}
+
+std::shared_ptr<Env> ReadSnapshot(std::filesystem::path const& path)
+{
+  auto fd = ::open(path.c_str(), O_RDONLY);
+  AFCT_CHECK(fd >= 0, fmt::format("Failed to open {}", path.string()));
+
+  struct stat status;
+  if (::fstat(fd, &status) != 0)
+  {
+    ::close(fd);
+    AFCT_ERROR(fmt::format("Failed to stat {}", path.string()));
+  }
+
+  size_t size = status.st_size;
+  void* mapping = size ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                       : nullptr;
+  ::close(fd);
+  AFCT_CHECK(
+      mapping != MAP_FAILED, fmt::format("Failed to map {}", path.string()));
+  if (mapping)
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+
+  try
+  {
+    auto env = DecodeSnapshot(
+        std::string_view(static_cast<char const*>(mapping), size));
+    ::munmap(mapping, size);
+    return env;
+  }
+  catch (...)
+  {
+    if (mapping)
+      ::munmap(mapping, size);
+    throw;
+  }
+}
+
+} // namespace afct
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "env.hpp"
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace afct {
+
+// everything reachable from env down to the shared builtins: bindings,
+// closures with their envs, lists and tables, each shared node once;
+// builtins are stored by name, and other native objects are refused
+std::string EncodeSnapshot(std::shared_ptr<Env> const& env);
+void WriteSnapshot(
+    std::shared_ptr<Env> const& env, std::filesystem::path const& path);
+
+// rebuilds the envs on top of Builtins() in one pass over the image
+std::shared_ptr<Env> DecodeSnapshot(std::string_view data);
+std::shared_ptr<Env> ReadSnapshot(std::filesystem::path const& path);
+
+} // namespace afct
@@ -0,0 +1,96 @@
+#include "task.hpp"
+
+#include "util.hpp"
+#include <fmt/format.h>
+
+namespace afct {
+
+namespace {
+
+Task* AsTask(Expr const& expr)
+{
+  if (!expr.is_builtin())
+    return nullptr;
+  return dynamic_cast<Task*>(expr.get_builtin().function.get());
+}
+
+} // namespace
+
+Task::Task(std::function<Expr()> f)
+  : _f(std::move(f))
+{}
+
+bool Task::ready() const
+{
+  return _done.load(std::memory_order_acquire);
+}
+
+Expr const& Task::await()
+{
+  run();
+  _done.wait(false, std::memory_order_acquire);
+  if (_error)
+    std::rethrow_exception(_error);
+  return _result;
+}
+
+Expr Task::call(List&, std::shared_ptr<Env>)
+{
+  AFCT_ERROR("Cannot call a task, await it instead");
+}
+
+void Task::run()
+{
+  if (_claimed.exchange(true, std::memory_order_acq_rel))
+    return;
+  try
+  {
+    _result = _f();
+  }
+  catch (...)
+  {
+    _error = std::current_exception();
+  }
+  _f = nullptr;
+  _done.store(true, std::memory_order_release);
+  _done.notify_all();
+}
+
+Expr Spawn(ThreadPool& pool, std::function<Expr()> f)
+{
+  auto task = std::make_shared<Task>(std::move(f));
+  pool.submit([task] { task->run(); });
+  return Expr{Builtin{"task", std::move(task)}};
+}
+
+bool IsTask(Expr const& expr)
+{
+  return AsTask(expr) != nullptr;
+}
+
+Task& GetTask(Expr const& expr)
+{
+  auto task = AsTask(expr);
+  AFCT_CHECK(task, fmt::format("Expected task but got {}", expr));
+  return *task;
+}
+
+Expr const& Await(Expr const& task)
+{
+  return GetTask(task).await();
+}
+
+List AwaitAll(List const& tasks)
+{
+  // fail on a bad argument before waiting on anything
+  for (auto const& task : tasks)
+    GetTask(task);
+
+  List results;
+  results.reserve(tasks.size());
+  for (auto const& task : tasks)
+    results.push_back(Await(task));
+  return results;
+}
+
+} // namespace afct
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "function.hpp"
+#include "pool.hpp"
+#include <atomic>
+#include <exception>
+
+namespace afct {
+
+// a computation queued on a pool, stored as a Builtin so scripts can hold
+// it; awaiting runs it inline if no worker has started it yet, else
+// blocks, and never picks up unrelated work that might in turn await a
+// task suspended beneath it on the same stack
+class Task : public INativeFunction
+{
+public:
+  explicit Task(std::function<Expr()> f);
+  bool ready() const;
+  // rethrows whatever the computation threw
+  Expr const& await();
+  Expr call(List& args, std::shared_ptr<Env> env) final;
+
+private:
+  friend Expr Spawn(ThreadPool& pool, std::function<Expr()> f);
+
+  // runs the computation unless another thread already claimed it
+  void run();
+
+  std::function<Expr()> _f;
+  std::atomic<bool> _claimed{false};
+  std::atomic<bool> _done{false};
+  Expr _result;
+  std::exception_ptr _error;
+};
+
+Expr Spawn(ThreadPool& pool, std::function<Expr()> f);
+bool IsTask(Expr const& expr);
+Task& GetTask(Expr const& expr);
+Expr const& Await(Expr const& task);
+List AwaitAll(List const& tasks);
+
+} // namespace afct
@@ -0,0 +1,141 @@
+#include "transduce.hpp"
+
+#include "lazy.hpp"
+#include "util.hpp"
+#include <fmt/format.h>
+
+namespace afct {
+
+namespace {
+
+Transducer const* AsTransducer(Expr const& expr)
+{
+  if (!expr.is_builtin())
+    return nullptr;
+  return dynamic_cast<Transducer const*>(expr.get_builtin().function.get());
+}
+
+// pushes each element of coll through the steps into sink, stopping early
+// once a take step is satisfied
+template<class Sink>
+void Run(
+    std::vector<TransducerStep> const& steps,
+    Expr const& coll,
+    std::shared_ptr<Env> const& env,
+    Sink sink)
+{
+  using Kind = TransducerStep::Kind;
+
+  std::vector<size_t> counts(steps.size());
+  List arg(1);
+  bool done = false;
+
+  ForEachElement(coll, [&](Expr value) {
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+      auto const& step = steps[i];
+      switch (step.kind)
+      {
+      case Kind::Map:
+        arg[0] = std::move(value);
+        value = Call(step.function, arg, env);
+        break;
+      case Kind::Filter:
+        arg[0] = value;
+        if (!Call(step.function, arg, env).truthy())
+          return true;
+        break;
+      case Kind::Take:
+        if (counts[i] >= step.n)
+          return false;
+        done = done || ++counts[i] == step.n;
+        break;
+      case Kind::Drop:
+        if (counts[i] < step.n)
+        {
+          counts[i]++;
+          return true;
+        }
+        break;
+      }
+    }
+    sink(std::move(value));
+    return !done;
+  });
+}
+
+} // namespace
+
+Transducer::Transducer(std::vector<TransducerStep> steps)
+  : _steps(std::move(steps))
+{}
+
+std::vector<TransducerStep> const& Transducer::steps() const
+{
+  return _steps;
+}
+
+Expr Transducer::call(List&, std::shared_ptr<Env>)
+{
+  AFCT_ERROR("Cannot call a transducer, pass it to transduce or into");
+}
+
+bool IsTransducer(Expr const& expr)
+{
+  return AsTransducer(expr) != nullptr;
+}
+
+Transducer const& GetTransducer(Expr const& expr)
+{
+  auto transducer = AsTransducer(expr);
+  AFCT_CHECK(transducer, fmt::format("Expected transducer but got {}", expr));
+  return *transducer;
+}
+
+Expr MakeTransducer(std::vector<TransducerStep> steps)
+{
+  return NativeFunctionToExpr<Transducer>("transducer", std::move(steps));
+}
+
+Expr Compose(List const& transducers)
+{
+  std::vector<TransducerStep> steps;
+  for (auto const& transducer : transducers)
+  {
+    auto const& more = GetTransducer(transducer).steps();
+    steps.insert(steps.end(), more.begin(), more.end());
+  }
+  return MakeTransducer(std::move(steps));
+}
+
+Expr Transduce(
+    Expr const& transducer,
+    Expr const& reducer,
+    Expr init,
+    Expr const& coll,
+    std::shared_ptr<Env> env)
+{
+  List args(2);
+  args[0] = std::move(init);
+  Run(GetTransducer(transducer).steps(), coll, env, [&](Expr value) {
+    args[1] = std::move(value);
+    args[0] = Call(reducer, args, env);
+  });
+  return std::move(args[0]);
+}
+
+List Into(
+    List list,
+    Expr const& transducer,
+    Expr const& coll,
+    std::shared_ptr<Env> env)
+{
+  if (coll.is_list())
+    list.reserve(list.size() + coll.get_list().size());
+  Run(GetTransducer(transducer).steps(), coll, env, [&](Expr value) {
+    list.push_back(std::move(value));
+  });
+  return list;
+}
+
+} // namespace afct
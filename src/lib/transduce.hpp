@@ -0,0 +1,56 @@
+#pragma once
+
+#include "function.hpp"
+#include <vector>
+
+namespace afct {
+
+struct TransducerStep
+{
+  enum class Kind
+  {
+    Map,
+    Filter,
+    Take,
+    Drop
+  };
+
+  Kind kind;
+  Expr function; // map and filter
+  size_t n{0}; // take and drop
+};
+
+// steps run element by element, so a pipeline makes one pass over its
+// input and builds no intermediate lists
+class Transducer : public INativeFunction
+{
+public:
+  explicit Transducer(std::vector<TransducerStep> steps);
+  std::vector<TransducerStep> const& steps() const;
+  Expr call(List& args, std::shared_ptr<Env> env) final;
+
+private:
+  std::vector<TransducerStep> _steps;
+};
+
+bool IsTransducer(Expr const& expr);
+Transducer const& GetTransducer(Expr const& expr);
+Expr MakeTransducer(std::vector<TransducerStep> steps);
+// earlier transducers see each element first
+Expr Compose(List const& transducers);
+
+// coll is a list or seq; reducer is called as (reducer acc element)
+Expr Transduce(
+    Expr const& transducer,
+    Expr const& reducer,
+    Expr init,
+    Expr const& coll,
+    std::shared_ptr<Env> env);
+// appends the transformed elements of coll to list
+List Into(
+    List list,
+    Expr const& transducer,
+    Expr const& coll,
+    std::shared_ptr<Env> env);
+
+} // namespace afct
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "expr.hpp"
+#include "util.hpp"
+#include <type_traits>
 
 namespace afct {
 
@@ -25,6 +27,91 @@ public:
   virtual void end_table() = 0;
 };
 
+// base for statically dispatched visitors, callbacks default to no-ops;
+// Visit is instantiated on the derived type, so the callbacks it hides
+// are the ones called
+class StaticVisitor
+{
+public:
+  void null_value()
+  {}
+  void bool_value(bool)
+  {}
+  void double_value(double)
+  {}
+  void int_value(int64_t)
+  {}
+  void string_value(std::string const&)
+  {}
+  void name_value(std::string const&)
+  {}
+  void lambda_value(Lambda const&)
+  {}
+  void builtin_value(Builtin const&)
+  {}
+  void start_list(size_t)
+  {}
+  void end_list()
+  {}
+  void start_table(size_t)
+  {}
+  void start_key()
+  {}
+  void end_key()
+  {}
+  void end_table()
+  {}
+};
+
+// resolved at compile time so callbacks can be inlined
+template<class V>
+requires(!std::is_pointer_v<V>) void Visit(Expr const& expr, V& visitor);
+
+// type-erased adapter over the static dispatch
 void Visit(Expr const& expr, IVisitor* visitor);
 
 } // namespace afct
+
+namespace afct {
+
+template<class V>
+requires(!std::is_pointer_v<V>) void Visit(Expr const& expr, V& visitor)
+{
+  switch (expr.get_type())
+  {
+  case Type::Null: visitor.null_value(); break;
+  case Type::Bool: visitor.bool_value(expr.get_bool()); break;
+  case Type::Double: visitor.double_value(expr.get_double()); break;
+  case Type::Int: visitor.int_value(expr.get_int()); break;
+  case Type::String: visitor.string_value(expr.get_string()); break;
+  case Type::Name: visitor.name_value(expr.get_name()); break;
+  case Type::Lambda: visitor.lambda_value(expr.get_lambda()); break;
+  case Type::Builtin: visitor.builtin_value(expr.get_builtin()); break;
+  case Type::List:
+  {
+    auto const& list = expr.get_list();
+    visitor.start_list(list.size());
+    for (auto const& element : list)
+      Visit(element, visitor);
+    visitor.end_list();
+    break;
+  }
+  case Type::Table:
+  {
+    auto const& table = expr.get_table();
+    visitor.start_table(table.size());
+    for (auto const& pair : table)
+    {
+      visitor.start_key();
+      Visit(pair.first, visitor);
+      visitor.end_key();
+      Visit(pair.second, visitor);
+    }
+    visitor.end_table();
+    break;
+  }
+  default: AFCT_ERROR("Visiting unknown type");
+  }
+}
+
+} // namespace afct
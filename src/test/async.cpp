@@ -0,0 +1,113 @@
+#include "lib/async.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#include "util.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+using namespace afct;
+using namespace std::chrono_literals;
+
+namespace {
+
+Expr EvalAsyncSimple(std::string input)
+{
+  return BlockOn(EvalAsync(Parse(std::move(input)), Prelude()));
+}
+
+AsyncExpr WriteLater(EventLoop& loop, int fd, std::string text)
+{
+  co_await Sleep(loop, 10ms);
+  AFCT_CHECK(write(fd, text.data(), text.size()) == ssize_t(text.size()), "");
+  close(fd);
+  co_return Expr{};
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(async_matches_eval)
+{
+  auto code = R"(
+    (begin
+      (define count
+        (lambda (n acc)
+          (if (= n 0) acc (count (- n 1) (+ acc 1)))))
+      (define t #("k" (count 3 0)))
+      (list (get t "k") (quote (a b)) (car '(1 2)) (force (delay 5))))
+  )";
+  BOOST_TEST(EvalAsyncSimple(code) == EvalSimple(code));
+
+  // tail calls run in the loop, not on the native stack
+  auto deep = "(begin (define f (lambda (n) (if (= n 0) 0 (f (- n 1))))) "
+              "(f 100000))";
+  BOOST_TEST(EvalAsyncSimple(deep) == Expr{0});
+
+  BOOST_CHECK_THROW(EvalAsyncSimple("(begin (sleep 1) (car '()))"), Exception);
+  BOOST_CHECK_THROW(EvalAsyncSimple("(undefined 1)"), Exception);
+}
+
+BOOST_AUTO_TEST_CASE(async_multiplex)
+{
+  // a thousand sleeping scripts share one thread
+  EventLoop loop;
+  auto env = Prelude();
+  int64_t sum = 0;
+  for (int64_t i = 0; i < 1000; i++)
+  {
+    auto local = std::make_shared<Env>(env);
+    local->set("n", Expr{i});
+    loop.spawn(
+        EvalAsync(Parse("(begin (sleep 50) n)"), local),
+        [&](Expr result, std::exception_ptr error) {
+          BOOST_TEST(!error);
+          sum += result.get_int();
+        });
+  }
+  BOOST_TEST(loop.active() == 1000);
+
+  auto start = std::chrono::steady_clock::now();
+  loop.run();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  BOOST_TEST(loop.active() == 0);
+  BOOST_TEST(sum == 499500);
+  BOOST_TEST(elapsed < 5s);
+}
+
+BOOST_AUTO_TEST_CASE(async_pipe)
+{
+  int fds[2];
+  BOOST_TEST(pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0);
+
+  EventLoop loop;
+  Expr read;
+  loop.spawn(ReadAll(loop, fds[0]), [&](Expr result, std::exception_ptr) {
+    read = std::move(result);
+  });
+  loop.spawn(WriteLater(loop, fds[1], "hello"), [](auto, auto) {});
+  loop.run();
+  close(fds[0]);
+
+  BOOST_TEST(read == Expr{String{"hello"}});
+}
+
+BOOST_AUTO_TEST_CASE(async_read_file)
+{
+  auto path = std::filesystem::temp_directory_path() / "afct_async_test.txt";
+  std::ofstream(path) << "contents";
+
+  auto env = Prelude();
+  env->set("path", Expr{String{path.string()}});
+  auto code = Parse("(read-file path)");
+  BOOST_TEST(BlockOn(EvalAsync(code, env)) == Expr{String{"contents"}});
+  // blocks on a private loop when called synchronously
+  BOOST_TEST(Eval(code, env) == Expr{String{"contents"}});
+
+  std::filesystem::remove(path);
+  BOOST_CHECK_THROW(Eval(code, env), Exception);
+}
@@ -0,0 +1,131 @@
+#include "lib/batch.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <filesystem>
+#include <fstream>
+
+using namespace afct;
+
+namespace {
+
+class ScriptDir
+{
+public:
+  ScriptDir() : _path(std::filesystem::temp_directory_path() / "afct_batch")
+  {
+    std::filesystem::remove_all(_path);
+    std::filesystem::create_directories(_path / "more");
+    for (int i = 0; i < 40; i++)
+      write(
+          fmt::format("{:02}.lisp", i),
+          fmt::format("(begin (define x {}) (* x x))", i));
+    write("more/bad.lisp", "(car 1)");
+    write("more/base.lisp", "(triple 5)");
+    write("more/notes.txt", "not a script");
+  }
+
+  void write(std::string const& name, std::string const& source)
+  {
+    std::ofstream(_path / name) << source;
+  }
+
+  ~ScriptDir()
+  {
+    std::filesystem::remove_all(_path);
+  }
+
+  std::filesystem::path const& path() const
+  {
+    return _path;
+  }
+
+private:
+  std::filesystem::path _path;
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(batch_collect)
+{
+  ScriptDir dir;
+  auto all = CollectScripts({dir.path().string()});
+  BOOST_TEST(all.size() == 42u);
+  BOOST_TEST(all.front() == dir.path() / "00.lisp");
+  BOOST_TEST(std::is_sorted(all.begin(), all.end()));
+
+  auto named = CollectScripts({(dir.path() / "more/notes.txt").string()});
+  BOOST_TEST(named.size() == 1u);
+
+  auto glob = CollectScripts({(dir.path() / "1*.lisp").string()});
+  BOOST_TEST(glob.size() == 10u);
+  BOOST_CHECK_THROW(
+      CollectScripts({(dir.path() / "none*.lisp").string()}), Exception);
+}
+
+BOOST_AUTO_TEST_CASE(batch_run)
+{
+  ScriptDir dir;
+  auto base = Prelude();
+  Eval(Parse("(define triple (lambda (x) (* 3 x)))"), base);
+
+  auto files = CollectScripts({dir.path().string()});
+  auto results = RunBatch(files, 4, base);
+  BOOST_TEST(results.size() == files.size());
+  for (int i = 0; i < 40; i++)
+  {
+    BOOST_TEST(results[i].path == files[i]);
+    BOOST_TEST(results[i].ok);
+    BOOST_TEST(results[i].value == Expr{i * i});
+  }
+  BOOST_TEST(!results[40].ok);
+  BOOST_TEST(!results[40].error.empty());
+  BOOST_TEST(results[41].value == Expr{15});
+  // definitions stay in each script's own env
+  BOOST_TEST(!base->find("x"));
+
+  auto summary = Summarize(results, std::chrono::milliseconds(100));
+  BOOST_TEST(summary.files == 42u);
+  BOOST_TEST(summary.failed == 1u);
+  BOOST_TEST(summary.p50 <= summary.p99);
+  BOOST_TEST(summary.p99 <= summary.max);
+  BOOST_TEST(summary.per_second == 420.0);
+
+  auto serial = RunBatch(files, 1);
+  BOOST_TEST(serial[0].value == Expr{0});
+  BOOST_TEST(!serial[41].ok);
+
+  // tables in the base are shared by every script, so read-only
+  Eval(Parse("(define lib #(\"a\" 1))"), base);
+  dir.write("write.lisp", "(set! lib \"a\" 2)");
+  dir.write("local.lisp", "(begin (define t #()) (set! t 1 2) t)");
+  auto writes = RunBatch(
+      {dir.path() / "write.lisp", dir.path() / "local.lisp"}, 2, base);
+  BOOST_TEST(!writes[0].ok);
+  BOOST_TEST(writes[1].value == Parse("#(1 2)"));
+  BOOST_TEST(Eval(Parse("(get lib \"a\")"), base) == Expr{1});
+}
+
+BOOST_AUTO_TEST_CASE(batch_timeout)
+{
+  ScriptDir dir;
+  dir.write(
+      "loop.lisp", "(begin (define loop (lambda (x) (loop x))) (loop 1))");
+  dir.write(
+      "map.lisp",
+      "(begin (define loop (lambda (x) (loop x))) (map loop (list 1)))");
+  auto files = std::vector<std::filesystem::path>{
+      dir.path() / "loop.lisp",
+      dir.path() / "map.lisp",
+      dir.path() / "07.lisp"};
+
+  auto results = RunBatch(files, 2, nullptr, std::chrono::milliseconds(100));
+  BOOST_TEST(!results[0].ok);
+  BOOST_TEST(results[0].error == "Timed out after 100 ms");
+  BOOST_TEST(!results[1].ok);
+  BOOST_TEST(results[1].error == "Timed out after 100 ms");
+  BOOST_TEST(results[2].value == Expr{49});
+}
@@ -0,0 +1,51 @@
+#include "lib/binary.hpp"
+
+#include "lib/parse.hpp"
+#include "lib/util.hpp"
+#include "util.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <limits>
+
+using namespace afct;
+
+BOOST_AUTO_TEST_CASE(binary_round_trip)
+{
+  auto code = R"(
+    (list null true false 2.7 -0.0 0 -1 27 "hello" 'name "hello" 'name
+      '(1 (2 (3))) #() '() #("a" #(1 '(2 3)) 4.5 "b" true null)))";
+  auto expr = EvalSimple(code);
+
+  BOOST_TEST(Decode(Encode(expr)) == expr);
+
+  for (auto i : {std::numeric_limits<int64_t>::min(),
+                 std::numeric_limits<int64_t>::max(),
+                 int64_t{-64},
+                 int64_t{64}})
+    BOOST_TEST(Decode(Encode(Expr{i})).get_int() == i);
+
+  auto d = Decode(Encode(Expr{0.1})).get_double();
+  BOOST_TEST(d == 0.1);
+}
+
+BOOST_AUTO_TEST_CASE(binary_dedup)
+{
+  List list;
+  for (int i = 0; i < 100; i++)
+    list.push_back(Expr{String{"a string long enough to be worth sharing"}});
+  auto encoded = Encode(Expr{list});
+
+  BOOST_TEST(encoded.size() < 300);
+  BOOST_TEST(Decode(encoded) == Expr{list});
+}
+
+BOOST_AUTO_TEST_CASE(binary_errors)
+{
+  BOOST_CHECK_THROW(Encode(EvalSimple("car")), Exception);
+  BOOST_CHECK_THROW(Encode(EvalSimple("(lambda (x) x)")), Exception);
+  BOOST_CHECK_THROW(Decode("nope"), Exception);
+
+  auto encoded = Encode(Parse("(1 2 3)"));
+  BOOST_CHECK_THROW(Decode(encoded.substr(0, encoded.size() - 1)), Exception);
+  BOOST_CHECK_THROW(Decode(encoded + "x"), Exception);
+}
@@ -86,3 +86,26 @@ BOOST_AUTO_TEST_CASE(builder_tables)
   bool ok = code == code_ordered || code == code_unordered;
   BOOST_TEST(ok);
 }
+
+BOOST_AUTO_TEST_CASE(builder_size_hints)
+{
+  std::pmr::monotonic_buffer_resource arena;
+  auto builder = Builder(&arena);
+  builder.start_list(3);
+  builder.int_value(1);
+  builder.start_table(2);
+  builder.string_key("a");
+  builder.start_list(1);
+  builder.int_value(2);
+  builder.end_list();
+  builder.end_table();
+  builder.int_value(3);
+  builder.end_list();
+
+  BOOST_TEST(builder.get_string() == R"((1 #("a" (2)) 3))");
+  BOOST_TEST(builder.get_expr().get_list().capacity() == 3);
+
+  auto expr = builder.take_expr();
+  BOOST_TEST(expr == Parse(R"((1 #("a" (2)) 3))"));
+  BOOST_TEST(builder.get_expr().is_null());
+}
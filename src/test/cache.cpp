@@ -0,0 +1,134 @@
+#include "lib/cache.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <vector>
+
+using namespace afct;
+
+namespace {
+
+auto const kSource = R"(
+  (begin
+    (define xs '(1 2.5 "three" #("four" 4)))
+    (define f (lambda (x) (* x 2)))
+    (f (length xs))))";
+
+std::string Slurp(std::filesystem::path const& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream stream;
+  stream << file.rdbuf();
+  return stream.str();
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(parse_cache)
+{
+  auto dir = std::filesystem::temp_directory_path() / "afct_parse_cache";
+  std::filesystem::remove_all(dir);
+  ParseCache cache(dir);
+  BOOST_TEST(cache.enabled());
+
+  auto expected = Parse(kSource);
+  BOOST_TEST(cache.parse(kSource) == expected);
+  auto entry = cache.entry(kSource);
+  BOOST_TEST(std::filesystem::exists(entry));
+  auto stored = Slurp(entry);
+
+  BOOST_TEST(cache.parse(kSource) == expected);
+  BOOST_TEST(Eval(cache.parse(kSource), Prelude()) == Expr{8});
+  BOOST_TEST(Slurp(entry) == stored);
+  BOOST_TEST(cache.entry("(+ 1 2)") != entry);
+
+  // damaged entries are parsed again and replaced
+  std::ofstream(entry, std::ios::trunc) << stored.substr(0, 40);
+  BOOST_TEST(cache.parse(kSource) == expected);
+  BOOST_TEST(Slurp(entry) == stored);
+
+  // same name, different source: compared, so a miss that replaces it
+  std::string other = "(+ 1 2)";
+  BOOST_TEST(cache.parse(other) == Parse(other));
+  std::filesystem::rename(cache.entry(other), entry);
+  BOOST_TEST(cache.parse(kSource) == expected);
+  BOOST_TEST(Slurp(entry) == stored);
+
+  std::filesystem::remove_all(dir);
+  cache.set_enabled(false);
+  BOOST_TEST(cache.parse(kSource) == expected);
+  BOOST_TEST(!std::filesystem::exists(dir));
+
+  // only afct turns the shared cache on
+  BOOST_TEST(!ParseCache::Default().enabled());
+}
+
+BOOST_AUTO_TEST_CASE(parse_cache_eviction)
+{
+  auto dir = std::filesystem::temp_directory_path() / "afct_parse_eviction";
+  std::filesystem::remove_all(dir);
+  ParseCache cache(dir, true, 4096);
+
+  std::vector<std::string> sources;
+  for (int i = 0; i < 64; i++)
+    sources.push_back(fmt::format("(list {} \"{}\")", i, std::string(40, 'x')));
+  for (auto const& source : sources)
+    BOOST_TEST(cache.parse(source) == Parse(source));
+
+  uintmax_t total = 0;
+  for (auto const& item : std::filesystem::directory_iterator(dir))
+    total += item.file_size();
+  BOOST_TEST(total <= 4096u);
+  BOOST_TEST(std::filesystem::exists(cache.entry(sources.back())));
+  BOOST_TEST(!std::filesystem::exists(cache.entry(sources.front())));
+  std::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(parse_cache_default_dir)
+{
+  std::vector<std::pair<char const*, std::optional<std::string>>> saved;
+  for (auto name : {"AFCT_CACHE_DIR", "XDG_CACHE_HOME", "HOME"})
+  {
+    saved.emplace_back(name, std::nullopt);
+    if (auto value = std::getenv(name))
+      saved.back().second = value;
+  }
+
+  ::unsetenv("AFCT_CACHE_DIR");
+  ::setenv("HOME", "/home/user", 1);
+  ::setenv("XDG_CACHE_HOME", "/var/cache", 1);
+  BOOST_TEST(ParseCache::DefaultDir() == "/var/cache/afct");
+  // empty and relative are ignored, per the XDG spec
+  for (auto ignored : {"", "cache"})
+  {
+    ::setenv("XDG_CACHE_HOME", ignored, 1);
+    BOOST_TEST(ParseCache::DefaultDir() == "/home/user/.cache/afct");
+  }
+  ::setenv("AFCT_CACHE_DIR", "/tmp/afct", 1);
+  BOOST_TEST(ParseCache::DefaultDir() == "/tmp/afct");
+
+  for (auto const& [name, value] : saved)
+  {
+    if (value)
+      ::setenv(name, value->c_str(), 1);
+    else
+      ::unsetenv(name);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(parse_cache_without_dir)
+{
+  ParseCache cache("");
+  BOOST_TEST(!cache.enabled());
+  cache.set_enabled(true);
+  BOOST_TEST(!cache.enabled());
+  BOOST_TEST(cache.parse("(+ 1 2)") == Parse("(+ 1 2)"));
+}
@@ -0,0 +1,100 @@
+#include "lib/context.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/function.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using namespace afct;
+
+BOOST_AUTO_TEST_CASE(shared_builtins)
+{
+  auto a = Prelude();
+  auto b = Prelude();
+  BOOST_TEST(a != b);
+  BOOST_TEST(
+      a->find("map")->get_builtin().function ==
+      b->find("map")->get_builtin().function);
+
+  Eval(Parse("(define map 1)"), a);
+  BOOST_TEST(*a->find("map") == Expr{1});
+  BOOST_TEST(b->find("map")->is_builtin());
+
+  BOOST_TEST(Builtins()->frozen());
+  BOOST_CHECK_THROW(Builtins()->set("map", Expr{1}), Exception);
+  BOOST_CHECK_THROW(Builtins()->clear(), Exception);
+}
+
+BOOST_AUTO_TEST_CASE(context_pool)
+{
+  ContextPool pool(2);
+  BOOST_TEST(pool.idle() == 2u);
+
+  Env* first = nullptr;
+  {
+    auto lease = pool.acquire();
+    first = lease.env().get();
+    BOOST_TEST(pool.idle() == 1u);
+    Eval(
+        Parse("(define f (lambda (n) (if (= n 0) 0 (f (- n 1)))))"),
+        lease.env());
+    BOOST_TEST(Eval(Parse("(f 10)"), lease.env()) == Expr{0});
+  }
+  BOOST_TEST(pool.idle() == 2u);
+
+  auto lease = pool.acquire();
+  BOOST_TEST(lease.env().get() == first);
+  BOOST_TEST(!lease.env()->find("f"));
+  BOOST_TEST(Eval(Parse("(+ 1 2)"), lease.env()) == Expr{3});
+}
+
+BOOST_AUTO_TEST_CASE(context_pool_escape)
+{
+  ContextPool pool;
+  Expr escaped;
+  {
+    auto lease = pool.acquire();
+    escaped = Eval(Parse("(lambda (x) x)"), lease.env());
+  }
+  BOOST_TEST(pool.idle() == 0u);
+
+  auto moved = pool.acquire();
+  auto lease = std::move(moved);
+  BOOST_TEST(lease.env() != escaped.get_lambda().env);
+}
+
+BOOST_AUTO_TEST_CASE(context_pool_base)
+{
+  auto base = Prelude();
+  Eval(Parse("(define twice (lambda (x) (* 2 x)))"), base);
+  ContextPool pool(1, 64, base);
+
+  auto lease = pool.acquire();
+  BOOST_TEST(lease.env()->outer() == base);
+  BOOST_TEST(Eval(Parse("(twice 21)"), lease.env()) == Expr{42});
+}
+
+BOOST_AUTO_TEST_CASE(read_only_tables)
+{
+  auto base = Prelude();
+  Eval(
+      Parse("(begin (define t #(\"k\" #())) (define n (list #())) "
+            "(define make (lambda (c) (lambda () '#(1 2)))) "
+            "(define f (make #())))"),
+      base);
+  ContextPool pool(0, 64, base);
+  BOOST_TEST(pool.read_only()->size() == 5u);
+
+  auto lease = pool.acquire();
+  auto set = Parse("(set! (get t \"k\") 1 2)");
+  BOOST_TEST(Eval(set, lease.env()) == Expr{2});
+  {
+    ReadOnlyTables::Scope scope(pool.read_only());
+    BOOST_CHECK_THROW(Eval(set, lease.env()), Exception);
+    BOOST_CHECK_THROW(Eval(Parse("(set! (f) 1 3)"), lease.env()), Exception);
+    auto fresh = Parse("(begin (define u #()) (set! u 1 2) (set! u 2 t) u)");
+    BOOST_TEST(Eval(fresh, lease.env()).get_table().size() == 2u);
+  }
+}
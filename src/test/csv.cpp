@@ -0,0 +1,107 @@
+#include "lib/csv.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#include "lib/querier.hpp"
+#include "lib/util.hpp"
+#include "util.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using namespace afct;
+
+BOOST_AUTO_TEST_CASE(csv_rows)
+{
+  auto text = "name,age,score,ok\r\n"
+              "\"Smith, J\",42,1.5,true\r\n"
+              "\"say \"\"hi\"\"\",7,,false\n"
+              "\n"
+              "x,,3,true";
+  auto rows = ParseCsv(
+      "name,age,score,ok\n\"multi\nline\",1,2,true", CsvOptions{});
+  BOOST_TEST(Querier(rows).get<std::string>("0/name") == "multi\nline");
+
+  auto querier = Querier(ParseCsv(text, CsvOptions{}));
+  BOOST_TEST(querier.get_list("").size() == 3);
+  BOOST_TEST(querier.get<std::string>("0/name") == "Smith, J");
+  BOOST_TEST(querier.get<std::string>("1/name") == "say \"hi\"");
+  BOOST_TEST(querier.get_view("0/age").is_int());
+  BOOST_TEST(querier.get_view("1/score").is_null());
+  BOOST_TEST(querier.get<double>("2/score") == 3.0);
+  BOOST_TEST(querier.get_view("2/score").is_double());
+  BOOST_TEST(querier.get<bool>("1/ok") == false);
+}
+
+BOOST_AUTO_TEST_CASE(csv_columns)
+{
+  CsvOptions options;
+  options.delimiter = '\t';
+  options.header = false;
+  options.columns = true;
+  auto expr = ParseCsv("a\t1\nb\tx\n", options);
+
+  BOOST_TEST(Querier(expr).get_list("0") == Parse(R"(("a" "b"))").get_list());
+  BOOST_TEST(Querier(expr).get_list("1") == Parse(R"(("1" "x"))").get_list());
+}
+
+BOOST_AUTO_TEST_CASE(csv_streaming)
+{
+  std::ostringstream text;
+  for (int i = 0; i < 1000; i++)
+    text << i << ",\"quoted " << i << "\"\n";
+  std::istringstream input(text.str());
+
+  size_t rows = 0;
+  int64_t sum = 0;
+  ReadCsv(
+      input,
+      CsvOptions{},
+      [&](CsvRow const& row) {
+        BOOST_TEST(row.size() == 2);
+        sum += std::stoll(row[0]);
+        rows++;
+      },
+      7);
+  BOOST_TEST(rows == 1000);
+  BOOST_TEST(sum == 499500);
+}
+
+BOOST_AUTO_TEST_CASE(csv_errors)
+{
+  BOOST_CHECK_THROW(ParseCsv("a,b\n1\n", CsvOptions{}), Exception);
+  BOOST_CHECK_THROW(ParseCsv("a\n\"open\n", CsvOptions{}), Exception);
+  BOOST_CHECK_THROW(ParseCsv("a\n\"x\"y\n", CsvOptions{}), Exception);
+  BOOST_CHECK_THROW(ParseCsv("a,b,a\n1,2,3\n", CsvOptions{}), Exception);
+}
+
+BOOST_AUTO_TEST_CASE(csv_inference)
+{
+  auto querier = Querier(ParseCsv(
+      "word,mixed,number\nnan,1,1e3\ninf,nan,-.5\n-inf,2.5,1e+1\n",
+      CsvOptions{}));
+  BOOST_TEST(querier.get<std::string>("0/word") == "nan");
+  BOOST_TEST(querier.get<std::string>("1/word") == "inf");
+  BOOST_TEST(querier.get<std::string>("1/mixed") == "nan");
+  BOOST_TEST(querier.get<std::string>("2/mixed") == "2.5");
+  BOOST_TEST(querier.get<double>("0/number") == 1000.0);
+  BOOST_TEST(querier.get<double>("1/number") == -0.5);
+  BOOST_TEST(querier.get<double>("2/number") == 10.0);
+}
+
+BOOST_AUTO_TEST_CASE(csv_builtin)
+{
+  auto path = std::filesystem::temp_directory_path() / "afct_csv_test.csv";
+  std::ofstream(path) << "id;name\n1;a\n2;b\n";
+
+  auto env = Prelude();
+  env->set("path", Expr{String{path.string()}});
+  auto code = R"((read-csv path #("delimiter" ";" "columns" true)))";
+  auto expr = Eval(std::string(code), env);
+  BOOST_TEST(Querier(expr).get_list("id") == Parse("(1 2)").get_list());
+
+  std::filesystem::remove(path);
+}
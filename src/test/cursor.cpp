@@ -0,0 +1,106 @@
+#include "lib/cursor.hpp"
+
+#include "lib/parse.hpp"
+#include "util.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+
+using namespace afct;
+
+namespace {
+
+std::string Events(ExprCursor& cursor)
+{
+  std::ostringstream stream;
+  while (true)
+  {
+    auto event = cursor.next();
+    switch (event)
+    {
+    case ExprCursor::Event::Value: stream << cursor.expr() << " "; break;
+    case ExprCursor::Event::StartList:
+      stream << "start list " << cursor.size() << " ";
+      break;
+    case ExprCursor::Event::EndList: stream << "end list "; break;
+    case ExprCursor::Event::StartTable:
+      stream << "start table " << cursor.size() << " ";
+      break;
+    case ExprCursor::Event::Key: stream << "key " << cursor.expr() << " "; break;
+    case ExprCursor::Event::EndTable: stream << "end table "; break;
+    case ExprCursor::Event::End: return stream.str();
+    }
+  }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(cursor_events)
+{
+  auto expr = EvalSimple(R"((list 1 "two" '(3) #(4 5)))");
+  ExprCursor cursor(expr);
+
+  auto expected = "start list 4 1 \"two\" start list 1 3 end list "
+                  "start table 1 key 4 5 end table end list ";
+  BOOST_TEST(Events(cursor) == expected);
+  BOOST_TEST((cursor.next() == ExprCursor::Event::End));
+
+  auto scalar = Expr{27};
+  ExprCursor scalar_cursor(scalar);
+  BOOST_TEST(Events(scalar_cursor) == "27 ");
+}
+
+BOOST_AUTO_TEST_CASE(cursor_skip)
+{
+  auto expr = EvalSimple(R"((list '(1 2 3) #("a" '(4 5) "b" 6) 7))");
+  ExprCursor cursor(expr);
+
+  BOOST_TEST((cursor.next() == ExprCursor::Event::StartList));
+  BOOST_TEST((cursor.next() == ExprCursor::Event::StartList));
+  cursor.skip();
+  BOOST_TEST((cursor.next() == ExprCursor::Event::EndList));
+  BOOST_TEST(cursor.depth() == 1);
+
+  BOOST_TEST((cursor.next() == ExprCursor::Event::StartTable));
+  while (cursor.next() == ExprCursor::Event::Key)
+  {
+    if (cursor.expr() == Expr{String{"a"}})
+      cursor.skip();
+    else
+      BOOST_TEST((cursor.next() == ExprCursor::Event::Value));
+  }
+  BOOST_TEST(cursor.depth() == 1);
+
+  // stopping early and resuming later
+  BOOST_TEST((cursor.next() == ExprCursor::Event::Value));
+  BOOST_TEST(cursor.expr() == Expr{7});
+  BOOST_TEST((cursor.next() == ExprCursor::Event::EndList));
+  BOOST_TEST((cursor.next() == ExprCursor::Event::End));
+
+  // skipping twice passes over one value only
+  auto table = EvalSimple(R"(#("a" 1 "b" 2))");
+  ExprCursor twice(table);
+  BOOST_TEST((twice.next() == ExprCursor::Event::StartTable));
+  size_t keys = 0;
+  while (twice.next() == ExprCursor::Event::Key)
+  {
+    keys++;
+    twice.skip();
+    twice.skip();
+  }
+  BOOST_TEST(keys == 2u);
+  BOOST_TEST((twice.next() == ExprCursor::Event::End));
+}
+
+BOOST_AUTO_TEST_CASE(cursor_deep)
+{
+  auto expr = Expr{List{}};
+  for (int i = 0; i < 1000; i++)
+    expr = Expr{List{expr}};
+
+  ExprCursor cursor(expr);
+  size_t events = 0;
+  while (cursor.next() != ExprCursor::Event::End)
+    events++;
+  BOOST_TEST(events == 2002);
+}
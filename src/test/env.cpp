@@ -0,0 +1,93 @@
+#include "lib/env.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/prelude.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <fmt/format.h>
+#include <thread>
+
+using namespace afct;
+
+BOOST_AUTO_TEST_CASE(env_scopes)
+{
+  for (auto outer : {std::make_shared<Env>(), Env::Shared()})
+  {
+    outer->set("a", Expr{1});
+    outer->set("b", Expr{2});
+    auto inner = std::make_shared<Env>(outer);
+    inner->set("a", Expr{3});
+
+    BOOST_TEST(inner->find("a").value() == Expr{3});
+    BOOST_TEST(inner->find("b").value() == Expr{2});
+    BOOST_TEST(outer->find("a").value() == Expr{1});
+    BOOST_TEST(!inner->find("c").has_value());
+    BOOST_TEST(!inner->shared());
+  }
+  BOOST_TEST(Env::Shared()->shared());
+
+  // shared in place, keeping what was bound
+  auto plain = std::make_shared<Env>();
+  plain->set("a", Expr{1});
+  plain->share();
+  BOOST_TEST(plain->shared());
+  plain->set("b", Expr{2});
+  BOOST_TEST(plain->find("a").value() == Expr{1});
+  BOOST_TEST(plain->bindings().size() == 2u);
+  plain->clear();
+  BOOST_TEST(!plain->find("a").has_value());
+}
+
+BOOST_AUTO_TEST_CASE(env_shared_eval)
+{
+  auto global = Env::Shared(Prelude());
+  Eval(std::string("(define square (lambda (x) (* x x)))"), global);
+
+  auto frame = std::make_shared<Env>(global);
+  BOOST_TEST(Eval(std::string("(square 4)"), frame) == Expr{16.0});
+  Eval(std::string("(define local 1)"), frame);
+  BOOST_TEST(!global->find("local").has_value());
+}
+
+// meant to be run under the tsan make target as well
+BOOST_AUTO_TEST_CASE(env_shared_stress)
+{
+  auto global = Env::Shared(Prelude());
+  global->set("count", Expr{0});
+  global->set("k0", Expr{0});
+  Eval(std::string("(define f (lambda (x) (+ x 1)))"), global);
+
+  constexpr int kWrites = 2000;
+  std::atomic<bool> done{false};
+  std::atomic<int> failures{0};
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++)
+  {
+    readers.emplace_back([&] {
+      auto frame = std::make_shared<Env>(global);
+      while (!done)
+      {
+        // keys are published before the count that refers to them
+        auto count = global->find("count").value().get_int();
+        if (!global->find(fmt::format("k{}", count)).has_value())
+          failures++;
+        if (Eval(std::string("(f 1)"), frame) != Expr{2.0})
+          failures++;
+      }
+    });
+  }
+
+  for (int i = 1; i <= kWrites; i++)
+  {
+    global->set(fmt::format("k{}", i), Expr{i});
+    global->set("count", Expr{i});
+  }
+  done = true;
+  for (auto& reader : readers)
+    reader.join();
+
+  BOOST_TEST(failures == 0);
+  BOOST_TEST(global->find("count").value() == Expr{kWrites});
+}
@@ -6,6 +6,7 @@
 #include "util.hpp"
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
+#include <cstdio>
 
 using namespace afct;
 
@@ -107,3 +108,37 @@ BOOST_AUTO_TEST_CASE(expr_ostream_table)
       stream.str() == sugared_ordered || stream.str() == sugared_unordered;
   BOOST_TEST(ok);
 }
+
+BOOST_AUTO_TEST_CASE(expr_format)
+{
+  auto code = R"((null () true false 2.7 2 "hello" + (1 (2 (3 '(4))))))";
+  auto expr = Parse(code);
+  std::ostringstream stream;
+  stream << expr;
+
+  BOOST_TEST(fmt::format("{}", expr) == stream.str());
+  fmt::memory_buffer buffer;
+  Format(buffer, expr);
+  BOOST_TEST(fmt::to_string(buffer) == stream.str());
+  auto lambda = EvalSimple("(lambda (a b) (+ a b))");
+  BOOST_TEST(fmt::format("{}", lambda) == "(lambda (a b) (+ a b))");
+}
+
+BOOST_AUTO_TEST_CASE(expr_write_chunked)
+{
+  List list;
+  for (int i = 0; i < 1000; i++)
+    list.push_back(Expr{List{Expr{i}, Expr{String{"x"}}}});
+  auto expr = Expr{list};
+
+  auto file = std::tmpfile();
+  Write(fileno(file), expr, 64);
+  std::rewind(file);
+  std::string written;
+  char chunk[4096];
+  while (auto n = std::fread(chunk, 1, sizeof(chunk), file))
+    written.append(chunk, n);
+  std::fclose(file);
+
+  BOOST_TEST(written == fmt::format("{}", expr));
+}
@@ -0,0 +1,67 @@
+#include "lib/image.hpp"
+
+#include "lib/querier.hpp"
+#include "lib/util.hpp"
+#include "util.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <filesystem>
+
+using namespace afct;
+
+BOOST_AUTO_TEST_CASE(image_round_trip)
+{
+  auto code = R"(
+    (list null true 2.7 -27 "hello" 'name '(1 (2)) #()
+      #("a" 1 2 "b" 2.5 '(3) true #("nested" "value"))))";
+  auto expr = EvalSimple(code);
+  auto image = Image::FromString(EncodeImage(expr));
+
+  BOOST_TEST(image->root().to_expr() == expr);
+  BOOST_TEST(image->root().size() == 9);
+  BOOST_TEST(image->root().at(3).get_int() == -27);
+  BOOST_TEST(image->root().at(4).get_string() == "hello");
+
+  auto table = image->root().at(8);
+  BOOST_TEST(table.find(Expr{String{"a"}})->get_int() == 1);
+  BOOST_TEST(table.find(Expr{2})->get_string() == "b");
+  BOOST_TEST(table.find(Expr{true})->find(Expr{String{"nested"}}).has_value());
+  BOOST_TEST(!table.find(Expr{String{"missing"}}).has_value());
+}
+
+BOOST_AUTO_TEST_CASE(image_querier)
+{
+  auto code = R"(
+    #("hosts" (list #("name" "a" "port" 80) #("name" "b" "port" 8080))
+      "flags" '(1 2 3)))";
+  auto path = std::filesystem::temp_directory_path() / "afct_image_test.img";
+  WriteImage(EvalSimple(code), path);
+
+  auto querier = Querier(Image::Open(path));
+  BOOST_TEST(querier.get<std::string>("hosts/1/name") == "b");
+  BOOST_TEST(querier.get<uint16_t>("hosts/0/port") == 80);
+  BOOST_TEST(querier.get_list("flags").size() == 3);
+  BOOST_TEST(querier.find_image_view("hosts/2").has_value() == false);
+  BOOST_CHECK_THROW(querier.get<int>("hosts/0/name"), Exception);
+  BOOST_CHECK_THROW(querier.find_view("hosts"), Exception);
+
+  std::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(image_errors)
+{
+  BOOST_CHECK_THROW(Image::FromString("not an image"), Exception);
+  BOOST_CHECK_THROW(EncodeImage(EvalSimple("car")), Exception);
+
+  auto data = EncodeImage(EvalSimple("'(1 2 3)"));
+  BOOST_CHECK_THROW(
+      Image::FromString(data.substr(0, data.size() - 8))->root().at(2),
+      Exception);
+
+  // a list whose first element points back at the list itself
+  auto root = data.substr(16, 8);
+  data.replace(data.size() - 24, 8, root);
+  auto cyclic = Image::FromString(data);
+  BOOST_CHECK_THROW(cyclic->root().at(0), Exception);
+  BOOST_CHECK_THROW(cyclic->root().to_expr(), Exception);
+}
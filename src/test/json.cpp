@@ -0,0 +1,67 @@
+#include "lib/json.hpp"
+
+#include "lib/parse.hpp"
+#include "lib/querier.hpp"
+#include "lib/util.hpp"
+#include "util.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using namespace afct;
+
+BOOST_AUTO_TEST_CASE(json_parse)
+{
+  auto json = R"(
+    {
+      "nothing": null, "bool": true, "int": -27, "big": 18446744073709551616,
+      "double": 2.5e1, "string": "a\"b\\c\n\u00e9\ud83d\ude00",
+      "list": [1, [2, []], {}],
+      "nested": {"a": {"b": [false]}}
+    })";
+  auto expr = ParseJson(json);
+  auto querier = Querier(expr);
+
+  BOOST_TEST(querier.get_view("nothing").is_null());
+  BOOST_TEST(querier.get<bool>("bool") == true);
+  BOOST_TEST(querier.get<int>("int") == -27);
+  BOOST_TEST(querier.get_view("big").is_double());
+  BOOST_TEST(querier.get<double>("double") == 25.0);
+  auto string = "a\"b\\c\n\xc3\xa9\xf0\x9f\x98\x80";
+  BOOST_TEST(querier.get<std::string>("string") == string);
+  auto list = EvalSimple("(list 1 (list 2 '()) #())");
+  BOOST_TEST(querier.get_view("list") == list);
+  BOOST_TEST(querier.get<bool>("nested/a/b/0") == false);
+
+  BOOST_TEST(ParseJson("  42 ") == Expr{42});
+}
+
+BOOST_AUTO_TEST_CASE(json_parse_errors)
+{
+  for (auto json : {"", "[1,]", "[1 2]", "{\"a\" 1}", "{1: 2}", "tru",
+                    "\"open", "[1]]", "01x", "\"\\ud800\"", "-", "01",
+                    "-00", "[007]", "00.5"})
+    BOOST_CHECK_THROW(ParseJson(json), Exception);
+
+  BOOST_TEST(ParseJson("0") == Expr{0});
+  BOOST_TEST(ParseJson("-0.5") == Expr{-0.5});
+  BOOST_TEST(ParseJson("10") == Expr{10});
+}
+
+BOOST_AUTO_TEST_CASE(json_write)
+{
+  auto expr = EvalSimple(R"((list null true 2.0 0.1 -3 "q" 'name '() #()))");
+  BOOST_TEST(ToJson(expr) == R"([null,true,2.0,0.1,-3,"q","name",[],{}])");
+  BOOST_TEST(ToJson(Expr{String{"\"\\\n\x01"}}) == R"("\"\\\n\u0001")");
+
+  auto table = EvalSimple(R"(#(1 '(1 2)))");
+  BOOST_TEST(ToJson(table) == R"({"1":[1,2]})");
+
+  BOOST_CHECK_THROW(ToJson(EvalSimple("car")), Exception);
+}
+
+BOOST_AUTO_TEST_CASE(json_round_trip)
+{
+  auto json = R"({"a":[1,2.5,"x",{"b":null}],"c":{}})";
+  auto expr = ParseJson(json);
+  BOOST_TEST(ParseJson(ToJson(expr)) == expr);
+}
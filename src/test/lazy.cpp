@@ -0,0 +1,97 @@
+#include "lib/lazy.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#include "util.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <limits>
+
+using namespace afct;
+
+BOOST_AUTO_TEST_CASE(lazy_range)
+{
+  BOOST_TEST(EvalSimple("(realize (range 4))") == Parse("(0 1 2 3)"));
+  BOOST_TEST(EvalSimple("(realize (range 2 5))") == Parse("(2 3 4)"));
+  BOOST_TEST(EvalSimple("(realize (range 5 0 -2))") == Parse("(5 3 1)"));
+  BOOST_TEST(EvalSimple("(realize (range 3 3))") == Parse("()"));
+  BOOST_TEST(EvalSimple("(realize (take 3 (range)))") == Parse("(0 1 2)"));
+  BOOST_CHECK_THROW(EvalSimple("(range 0 1 0)"), Exception);
+
+  // ranges end rather than wrap past the largest int
+  auto constexpr max = std::numeric_limits<int64_t>::max();
+  auto constexpr min = std::numeric_limits<int64_t>::min();
+  BOOST_TEST(SeqToList(LazyRange(max - 1, max, 2)) == (List{Expr{max - 1}}));
+  BOOST_TEST(SeqToList(LazyRange(max - 1, std::nullopt)).size() == 2);
+  BOOST_TEST(SeqToList(LazyRange(min + 1, min, -5)) == (List{Expr{min + 1}}));
+
+  // chunk boundaries
+  BOOST_TEST(SeqToList(LazyRange(0, 1000)).size() == 1000);
+  BOOST_TEST(SeqToList(LazyRange(0, kSeqChunkSize)).size() == kSeqChunkSize);
+}
+
+BOOST_AUTO_TEST_CASE(lazy_pipeline)
+{
+  auto code = R"(
+    (realize
+      (take 4
+        (drop 100
+          (filter (lambda (x) (= (* 2 (int (/ x 2))) x))
+            (map (lambda (x) (+ x 1)) (range))))))
+  )";
+  BOOST_TEST(EvalSimple(code) == Parse("(202 204 206 208)"));
+
+  auto doubles = "(realize (take 5 (iterate (lambda (x) (* x 2)) 1)))";
+  BOOST_TEST(EvalSimple(doubles) == Parse("(1 2 4 8 16)"));
+
+  // eager over lists, lazy over seqs
+  BOOST_TEST(EvalSimple("(map (lambda (x) x) '(1 2))").is_list());
+  BOOST_TEST(IsSeq(EvalSimple("(map (lambda (x) x) (range 2))")));
+  BOOST_TEST(EvalSimple("(take 2 '(1 2 3))") == Parse("(1 2)"));
+  BOOST_TEST(EvalSimple("(drop 5 '(1 2 3))") == Parse("()"));
+}
+
+BOOST_AUTO_TEST_CASE(lazy_only_computes_what_is_taken)
+{
+  auto env = Prelude();
+  Eval(std::string("(define calls (table))"), env);
+  auto code = R"(
+    (define seq
+      (map (lambda (x) (set! calls x true)) (range 1000000)))
+  )";
+  Eval(std::string(code), env);
+  BOOST_TEST(Eval(std::string("(length calls)"), env) == Expr{0});
+
+  Eval(std::string("(realize (take 3 seq))"), env);
+  BOOST_TEST(Eval(std::string("(length calls)"), env) == Expr{3});
+
+  // a seq restarts on every realize
+  auto twice = "(= (realize (take 3 seq)) (realize (take 3 seq)))";
+  BOOST_TEST(Eval(std::string(twice), env) == Expr{true});
+}
+
+BOOST_AUTO_TEST_CASE(lazy_large_range)
+{
+  // nothing is materialised besides the final chunk
+  auto seq = LazyDrop(LazyRange(0, 10'000'000), 9'999'998);
+  BOOST_TEST(SeqToList(seq) == Parse("(9999998 9999999)").get_list());
+}
+
+BOOST_AUTO_TEST_CASE(lazy_promise)
+{
+  auto env = Prelude();
+  Eval(std::string("(define n 0)"), env);
+  auto code = "(define p (delay (begin (define n (+ n 1)) n)))";
+  Eval(std::string(code), env);
+  BOOST_TEST(Eval(std::string("n"), env) == Expr{0});
+  BOOST_TEST(Eval(std::string("(force p)"), env) == Expr{1});
+  BOOST_TEST(Eval(std::string("(force p)"), env) == Expr{1});
+  BOOST_TEST(Eval(std::string("(force 7)"), env) == Expr{7});
+  BOOST_CHECK_THROW(Eval(std::string("(p)"), env), Exception);
+
+  // a promise that forces itself fails instead of deadlocking
+  Eval(std::string("(define q (delay (+ 1 (force q))))"), env);
+  BOOST_CHECK_THROW(Eval(std::string("(force q)"), env), Exception);
+  BOOST_CHECK_THROW(Eval(std::string("(force q)"), env), Exception);
+}
@@ -0,0 +1,79 @@
+#include "lib/memory.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using namespace afct;
+
+BOOST_AUTO_TEST_CASE(memory_account)
+{
+  auto account = std::make_shared<MemoryAccount>();
+  {
+    MemoryScope scope(account);
+    auto env = Prelude();
+    auto result = Eval(
+        Parse("(map (lambda (x) (list x x)) (list 1 2 3))"), env);
+    BOOST_TEST(result.get_list().size() == 3u);
+    BOOST_TEST(account->bytes() > 0u);
+    BOOST_TEST(account->peak() >= account->bytes());
+    BOOST_TEST(account->objects(MemoryKind::List) >= 4u);
+    // the builtins are shared by every env, so nobody is charged for them
+    BOOST_TEST(account->objects(MemoryKind::Builtin) == 0u);
+    BOOST_TEST(account->objects(MemoryKind::Env) >= 1u);
+  }
+  BOOST_TEST(account->bytes() == 0u);
+  BOOST_TEST(account->objects(MemoryKind::List) == 0u);
+  BOOST_TEST(account->objects(MemoryKind::Env) == 0u);
+  BOOST_TEST(account->peak() > 0u);
+
+  auto outside = Expr{List{Expr{1}}};
+  BOOST_TEST(account->objects(MemoryKind::List) == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(memory_account_limit)
+{
+  auto account = std::make_shared<MemoryAccount>(1 << 16);
+  MemoryScope scope(account);
+  auto env = Prelude();
+  BOOST_CHECK_THROW(
+      Eval(
+          Parse(
+              "(begin (define grow (lambda (l) (grow (append l \"x\")))) "
+              "(grow (list)))"),
+          env),
+      Exception);
+  BOOST_TEST(account->bytes() <= account->limit());
+  BOOST_TEST(Eval(Parse("(+ 1 2)"), env) == Expr{3});
+}
+
+BOOST_AUTO_TEST_CASE(memory_account_pool_work)
+{
+  // work handed to the pool is charged to the account that handed it over
+  auto account = std::make_shared<MemoryAccount>(1 << 16);
+  MemoryScope scope(account);
+  auto env = Prelude();
+  // the sleep lets a worker take the task before await would run it
+  auto code = Parse("(begin (define t (spawn list 1 2)) (sleep 50) (await t))");
+  auto lists = account->objects(MemoryKind::List);
+  auto result = Eval(code, env);
+  BOOST_TEST(account->objects(MemoryKind::List) == lists + 1);
+
+  Eval(Parse("(define grow (lambda (l) (grow (append l \"x\"))))"), env);
+  BOOST_CHECK_THROW(
+      Eval(Parse("(pmap (lambda (x) (grow (list))) (list 1 2 3 4))"), env),
+      Exception);
+  BOOST_TEST(account->bytes() <= account->limit());
+}
+
+BOOST_AUTO_TEST_CASE(memory_account_resource)
+{
+  auto account = std::make_shared<MemoryAccount>();
+  {
+    Expr list(List{Expr{1}, Expr{2}}, account.get());
+    BOOST_TEST(account->bytes() >= sizeof(List));
+  }
+  BOOST_TEST(account->bytes() == 0u);
+}
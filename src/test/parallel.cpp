@@ -0,0 +1,92 @@
+#include "lib/parallel.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#include "util.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+
+using namespace afct;
+
+namespace {
+
+List Ints(int64_t n)
+{
+  List list;
+  for (int64_t i = 0; i < n; i++)
+    list.emplace_back((i * 7919) % n);
+  return list;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(parallel_map_filter)
+{
+  ThreadPool pool(4);
+  auto env = Prelude();
+  auto input = Ints(5000);
+
+  auto square = Eval(std::string("(lambda (x) (* x x))"), env);
+  auto mapped = ParallelMap(pool, square, input, env);
+  BOOST_TEST(mapped.size() == input.size());
+  for (size_t i = 0; i < input.size(); i++)
+    BOOST_TEST(mapped[i].get_numeric() == std::pow(input[i].get_int(), 2));
+
+  auto small = Eval(std::string("(lambda (x) (< x 10))"), env);
+  auto filtered = ParallelFilter(pool, small, input, env);
+  List expected;
+  for (auto const& e : input)
+  {
+    if (e.get_int() < 10)
+      expected.push_back(e);
+  }
+  BOOST_TEST(filtered == expected);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_reduce_sort)
+{
+  ThreadPool pool(4);
+  auto env = Prelude();
+  auto input = Ints(3000);
+
+  auto plus = env->find("+").value();
+  auto sum = ParallelReduce(pool, plus, Expr{1}, input, env);
+  BOOST_TEST(sum.get_numeric() == 1 + 2999.0 * 3000 / 2);
+  BOOST_TEST(ParallelReduce(pool, plus, Expr{1}, List{}, env) == Expr{1});
+
+  auto sorted = ParallelSort(pool, Expr{}, input, env);
+  for (size_t i = 0; i < sorted.size(); i++)
+    BOOST_TEST(sorted[i] == Expr{static_cast<int64_t>(i)});
+
+  auto greater = env->find(">").value();
+  auto descending = ParallelSort(pool, greater, input, env);
+  BOOST_TEST(descending.front() == Expr{2999});
+  BOOST_TEST(descending.back() == Expr{0});
+}
+
+BOOST_AUTO_TEST_CASE(parallel_builtins)
+{
+  BOOST_TEST(EvalSimple("(pmap (lambda (x) (+ x 1)) '(1 2 3))") ==
+      Parse("(2.0 3.0 4.0)"));
+  BOOST_TEST(EvalSimple("(pfilter (lambda (x) (> x 1)) '(1 2 3))") ==
+      Parse("(2 3)"));
+  BOOST_TEST(EvalSimple("(preduce + 0 '(1 2 3))") == Expr{6.0});
+  BOOST_TEST(EvalSimple(R"((psort '("b" "c" "a")))") ==
+      Parse(R"(("a" "b" "c"))"));
+
+  // stable, and the input list is left alone
+  auto env = Prelude();
+  auto code = R"(
+    (begin
+      (define xs '((1 "a") (0 "b") (1 "c") (0 "d")))
+      (psort (lambda (a b) (< (car a) (car b))) xs))
+  )";
+  BOOST_TEST(Eval(std::string(code), env) ==
+      Parse(R"(((0 "b") (0 "d") (1 "a") (1 "c")))"));
+  BOOST_TEST(Eval(std::string("(car (car xs))"), env) == Expr{1});
+
+  BOOST_CHECK_THROW(EvalSimple("(pmap car '(1 2))"), Exception);
+  BOOST_CHECK_THROW(EvalSimple("(psort '(1 \"a\"))"), Exception);
+}
@@ -0,0 +1,76 @@
+#include "lib/pool.hpp"
+
+#include "lib/util.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <numeric>
+
+using namespace afct;
+
+BOOST_AUTO_TEST_CASE(pool_parallel_for)
+{
+  ThreadPool pool(4);
+  BOOST_TEST(pool.size() == 4);
+
+  std::vector<int> hits(10'000);
+  ParallelFor(pool, hits.size(), 7, [&](size_t b, size_t e) {
+    for (auto i = b; i < e; i++)
+      hits[i]++;
+  });
+  BOOST_TEST(std::accumulate(hits.begin(), hits.end(), 0) == 10'000);
+  BOOST_TEST(*std::min_element(hits.begin(), hits.end()) == 1);
+
+  ParallelFor(pool, 0, 1, [](size_t, size_t) { throw 1; });
+}
+
+BOOST_AUTO_TEST_CASE(pool_nested)
+{
+  // each caller claims the inner chunks itself rather than waiting on
+  // workers that are all busy with the outer ones
+  ThreadPool pool(2);
+  std::atomic<int> total{0};
+  ParallelFor(pool, 8, 1, [&](size_t, size_t) {
+    ParallelFor(pool, 100, 10, [&](size_t b, size_t e) {
+      total += static_cast<int>(e - b);
+    });
+  });
+  BOOST_TEST(total == 800);
+}
+
+BOOST_AUTO_TEST_CASE(pool_exceptions)
+{
+  ThreadPool pool(3);
+  std::atomic<int> ran{0};
+  BOOST_CHECK_THROW(
+      ParallelFor(
+          pool,
+          100,
+          1,
+          [&](size_t b, size_t) {
+            ran++;
+            AFCT_CHECK(b != 50, "fifty");
+          }),
+      Exception);
+  BOOST_TEST(ran <= 100);
+
+  // the pool is still usable afterwards
+  std::atomic<int> after{0};
+  ParallelFor(pool, 10, 1, [&](size_t, size_t) { after++; });
+  BOOST_TEST(after == 10);
+}
+
+BOOST_AUTO_TEST_CASE(pool_no_workers)
+{
+  ThreadPool pool(0);
+  int sum = 0;
+  ParallelFor(pool, 10, 3, [&](size_t b, size_t e) {
+    sum += static_cast<int>(e - b);
+  });
+  BOOST_TEST(sum == 10);
+
+  // unrelated queued work is left to the pool, not run by the caller
+  bool unrelated = false;
+  pool.submit([&] { unrelated = true; });
+  ParallelFor(pool, 10, 1, [](size_t, size_t) {});
+  BOOST_TEST(!unrelated);
+}
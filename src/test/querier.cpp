@@ -5,7 +5,9 @@
 #include "lib/util.hpp"
 #include "util.hpp"
 #define BOOST_TEST_DYN_LINK
+#include <algorithm>
 #include <boost/test/unit_test.hpp>
+#include <thread>
 
 using namespace afct;
 
@@ -146,3 +148,136 @@ BOOST_AUTO_TEST_CASE(querier_types)
   BOOST_TEST(querier.get<std::string>("string") == "hello");
   BOOST_TEST(querier.get<std::string>("name") == "lambda");
 }
+
+BOOST_AUTO_TEST_CASE(querier_views)
+{
+  auto code = R"(#("toplevel" #("onetwo" '(1 2) "name" "hello" "t" #(1 2))))";
+  auto querier = Querier(EvalSimple(code));
+
+  auto const& name = querier.get_view("toplevel/name");
+  BOOST_TEST(&name == &querier.get_view("toplevel/name"));
+  BOOST_TEST(name.get_string() == "hello");
+  BOOST_TEST(querier.find_view("toplevel/missing") == nullptr);
+  BOOST_CHECK_THROW(querier.get_view("toplevel/missing"), Exception);
+
+  auto list = querier.get_list_view("toplevel/onetwo");
+  BOOST_TEST(list.size() == 2);
+  BOOST_TEST(list[0] == Expr{1});
+  BOOST_TEST(list[1] == Expr{2});
+  BOOST_CHECK_THROW(querier.get_list_view("toplevel/name"), Exception);
+
+  for (auto const& key : querier.get_keys("toplevel/t"))
+    BOOST_TEST(key == Expr{1});
+  for (auto const& value : querier.get_values("toplevel/t"))
+    BOOST_TEST(value == Expr{2});
+  BOOST_TEST(std::ranges::distance(querier.get_table_view("toplevel")) == 3);
+}
+
+BOOST_AUTO_TEST_CASE(querier_query)
+{
+  auto code = R"(
+    #(
+      "servers" (list
+        #("host" "a" "ports" '(1 2))
+        #("host" "b" "ports" '(3))
+        #("host" "c" "tags" #("host" "d")))))";
+  auto querier = Querier(EvalSimple(code));
+
+  BOOST_TEST(querier.get<std::string>("servers/1/host") == "b");
+  BOOST_TEST(querier.get<int>("servers/0/ports/1") == 2);
+  BOOST_TEST(querier.find_view("servers/3/host") == nullptr);
+
+  std::vector<std::string> hosts;
+  for (auto const& host : querier.query("servers/*/host"))
+    hosts.push_back(host.get_string());
+  BOOST_TEST(hosts == std::vector<std::string>({"a", "b", "c"}));
+
+  int64_t sum = 0;
+  for (auto const& port : querier.query("servers/*/ports/*"))
+    sum += port.get_int();
+  BOOST_TEST(sum == 6);
+
+  std::vector<std::string> all_hosts;
+  for (auto const& host : querier.query("**/host"))
+    all_hosts.push_back(host.get_string());
+  std::sort(all_hosts.begin(), all_hosts.end());
+  BOOST_TEST(all_hosts == std::vector<std::string>({"a", "b", "c", "d"}));
+
+  auto range = querier.query("servers/*/missing");
+  BOOST_TEST((range.begin() == range.end()));
+}
+
+BOOST_AUTO_TEST_CASE(querier_index)
+{
+  auto code = R"(
+    #(
+      "routes" (list
+        #("id" 1 "to" "a")
+        #("id" 2 "to" "b")
+        #("to" "no id")
+        #("id" "three" "to" "c"))))";
+  auto querier = Querier(EvalSimple(code));
+
+  BOOST_CHECK_THROW(querier.find_by("routes", "id", Expr{1}), Exception);
+
+  querier.index("routes", "id");
+  BOOST_TEST(querier.index_stats("routes", "id").entries == 3);
+
+  auto route = querier.find_by("routes", "id", Expr{2});
+  BOOST_TEST(route != nullptr);
+  BOOST_TEST(Querier(*route).get<std::string>("to") == "b");
+  route = querier.find_by("routes", "id", Expr{String{"three"}});
+  BOOST_TEST(Querier(*route).get<std::string>("to") == "c");
+  BOOST_TEST(querier.find_by("routes", "id", Expr{4}) == nullptr);
+  // numeric keys match by value
+  route = querier.find_by("routes", "id", Expr{2.0});
+  BOOST_TEST(route != nullptr);
+  BOOST_TEST(Querier(*route).get<std::string>("to") == "b");
+
+  auto stats = querier.index_stats("routes", "id");
+  BOOST_TEST(stats.built);
+  BOOST_TEST(stats.bytes > 0);
+
+  querier.set_root(EvalSimple(R"(#("routes" (list #("id" 4 "to" "d"))))"));
+  BOOST_TEST(querier.find_by("routes", "id", Expr{2}) == nullptr);
+  route = querier.find_by("routes", "id", Expr{4});
+  BOOST_TEST(Querier(*route).get<std::string>("to") == "d");
+
+  querier.set_root(EvalSimple(R"(#("routes" (list #("id" 5.0 "to" "e"))))"));
+  route = querier.find_by("routes", "id", Expr{5});
+  BOOST_TEST(route != nullptr);
+  BOOST_TEST(Querier(*route).get<std::string>("to") == "e");
+}
+
+BOOST_AUTO_TEST_CASE(querier_index_changes)
+{
+  auto root = EvalSimple(R"(#("routes" (list #("id" 1) #("id" 2))))");
+  auto querier = Querier(root);
+  querier.index("routes", "id");
+  BOOST_TEST(querier.find_by("routes", "id", Expr{1}) != nullptr);
+
+  // a record replaced in place, the list keeping its size
+  auto& routes = root.get_table().at(Expr{String{"routes"}}).get_list();
+  routes[0] = EvalSimple(R"(#("id" 3))");
+  BOOST_TEST(querier.find_by("routes", "id", Expr{1}) == nullptr);
+  BOOST_TEST(querier.find_by("routes", "id", Expr{3}) == &routes[0]);
+
+  // a field changed in place is picked up once indexed again
+  routes[1].get_table()[Expr{String{"id"}}] = Expr{4};
+  BOOST_TEST(querier.find_by("routes", "id", Expr{2}) == nullptr);
+  querier.index("routes", "id");
+  BOOST_TEST(querier.find_by("routes", "id", Expr{4}) == &routes[1]);
+
+  // lookups from several threads share one index
+  querier.index("routes", "id");
+  std::vector<std::thread> threads;
+  std::atomic<int> found{0};
+  for (int t = 0; t < 4; t++)
+    threads.emplace_back([&] {
+      for (int i = 0; i < 100; i++)
+        found += querier.find_by("routes", "id", Expr{3}) != nullptr;
+    });
+  for (auto& thread : threads)
+    thread.join();
+  BOOST_TEST(found == 400);
+}
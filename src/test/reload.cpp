@@ -0,0 +1,128 @@
+#include "lib/reload.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <filesystem>
+#include <fstream>
+
+using namespace afct;
+
+namespace {
+
+using Names = std::vector<std::string>;
+
+auto const kLibrary = R"(
+  (begin
+    (define base 10)
+    (define scale (lambda (x) (* x base)))
+    (define scaled (scale 2))
+    (define other 1)
+    (define table #("scaled" scaled))
+    (define seen #())
+    (set! seen "other" other))
+)";
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(reload_changed_definitions)
+{
+  auto env = Prelude();
+  Reloader reloader("unused.lisp", env);
+
+  BOOST_TEST(
+      reloader.update(Parse(kLibrary)) ==
+          Names({"base", "scale", "scaled", "other", "table", "seen"}),
+      boost::test_tools::per_element());
+  BOOST_TEST(reloader.update(Parse(kLibrary)).empty());
+
+  // base feeds scale, scaled and table, but not other
+  std::string edited = kLibrary;
+  edited.replace(edited.find("base 10"), 7, "base 100");
+  BOOST_TEST(
+      reloader.update(Parse(edited)) ==
+          Names({"base", "scale", "scaled", "table"}),
+      boost::test_tools::per_element());
+  BOOST_TEST(*env->find("scaled") == Expr{200});
+  BOOST_TEST(Eval(Parse("(get table \"scaled\")"), env) == Expr{200});
+
+  edited.replace(edited.find("other 1"), 7, "other 2");
+  BOOST_TEST(
+      reloader.update(Parse(edited)) == Names({"other"}),
+      boost::test_tools::per_element());
+  BOOST_TEST(*env->find("other") == Expr{2});
+  // the plain form that mentions other ran again
+  BOOST_TEST(Eval(Parse("(get seen \"other\")"), env) == Expr{2});
+}
+
+BOOST_AUTO_TEST_CASE(reload_plain_forms)
+{
+  auto env = Prelude();
+  Reloader reloader("unused.lisp", env);
+  std::string program =
+      "(begin (define t #()) (set! t \"a\" 1) (define n (get t \"a\")))";
+  reloader.update(Parse(program));
+  BOOST_TEST(*env->find("n") == Expr{1});
+
+  // the set! changes t, so n is read again, but t isn't redefined
+  program.replace(program.find("\"a\" 1"), 5, "\"a\" 2");
+  BOOST_TEST(
+      reloader.update(Parse(program)) == Names({"n"}),
+      boost::test_tools::per_element());
+  BOOST_TEST(*env->find("n") == Expr{2});
+
+  // a removed set! leaves its write behind
+  BOOST_TEST(
+      reloader.update(Parse("(begin (define t #()) (define n 0))")) ==
+          Names({"n"}),
+      boost::test_tools::per_element());
+  BOOST_TEST(Eval(Parse("(get t \"a\")"), env) == Expr{2});
+}
+
+BOOST_AUTO_TEST_CASE(reload_after_failure)
+{
+  auto env = Prelude();
+  Reloader reloader("unused.lisp", env);
+  reloader.update(
+      Parse("(begin (define a 1) (define b (+ a 1)) (define c (+ b 1)))"));
+
+  BOOST_CHECK_THROW(
+      reloader.update(Parse(
+          "(begin (define a 2) (define b (car a)) (define c (+ b 1)))")),
+      Exception);
+  BOOST_TEST(*env->find("a") == Expr{2});
+  BOOST_TEST(*env->find("c") == Expr{3});
+
+  BOOST_TEST(
+      reloader.update(Parse(
+          "(begin (define a 2) (define b (+ a 1)) (define c (+ b 1)))")) ==
+          Names({"b", "c"}),
+      boost::test_tools::per_element());
+  BOOST_TEST(*env->find("c") == Expr{4});
+}
+
+BOOST_AUTO_TEST_CASE(reload_file)
+{
+  auto path = std::filesystem::temp_directory_path() / "afct_reload.lisp";
+  std::ofstream(path) << "(begin (define x 1) (define y (+ x 1)))";
+
+  auto env = Prelude();
+  Reloader reloader(path, env);
+  BOOST_TEST(reloader.stale());
+  BOOST_TEST(reloader.reload().size() == 2u);
+  BOOST_TEST(!reloader.stale());
+
+  std::ofstream(path) << "(begin (define x 5) (define y (+ x 1)))";
+  std::filesystem::last_write_time(
+      path,
+      std::filesystem::last_write_time(path) + std::chrono::seconds(1));
+  BOOST_TEST(reloader.stale());
+  reloader.reload();
+  BOOST_TEST(*env->find("y") == Expr{6});
+
+  std::filesystem::remove(path);
+  BOOST_TEST(!reloader.stale());
+  BOOST_CHECK_THROW(reloader.reload(), Exception);
+}
@@ -0,0 +1,175 @@
+#include "lib/scheduler.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+
+using namespace afct;
+
+namespace {
+
+auto const kRunaway = "(begin (define loop (lambda () (loop))) (loop))";
+
+std::string CountDown(int n)
+{
+  return fmt::format(
+      "(begin (define f (lambda (n) (if (= n 0) \"done\" (f (- n 1))))) "
+      "(f {}))",
+      n);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(script_slices)
+{
+  Script runaway(Parse(kRunaway), Prelude());
+  BOOST_TEST(!runaway.run(1000));
+  BOOST_TEST(runaway.steps() == 1000u);
+  BOOST_TEST(!runaway.run(500));
+  BOOST_TEST(runaway.steps() == 1500u);
+  BOOST_CHECK_THROW(runaway.result(), Exception);
+
+  // state survives preemption
+  Script script(Parse(CountDown(2000)), Prelude());
+  int slices = 1;
+  while (!script.run(100))
+    slices++;
+  BOOST_TEST(slices > 10);
+  BOOST_TEST(script.result() == Expr{String{"done"}});
+  BOOST_CHECK_THROW(script.run(1), Exception);
+
+  Script failing(Parse("(car '())"), Prelude());
+  BOOST_TEST(failing.run(100));
+  BOOST_CHECK_THROW(failing.result(), Exception);
+}
+
+BOOST_AUTO_TEST_CASE(script_fuel_through_builtins)
+{
+  // the loop runs inside map, where the script cannot be preempted
+  auto const through_map =
+      "(begin (define loop (lambda (x) (loop x))) (map loop (list 1)))";
+  Script limited(Parse(through_map), Prelude());
+  limited.fuel().set_limit(10000);
+  BOOST_TEST(limited.run(100));
+  BOOST_TEST(limited.steps() == 10000u);
+  BOOST_CHECK_THROW(limited.result(), Exception);
+
+  Script late(Parse(through_map), Prelude());
+  late.fuel().set_deadline(
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(20));
+  BOOST_TEST(late.run(100));
+  BOOST_CHECK_THROW(late.result(), Exception);
+
+  // work handed to the pool charges the same fuel
+  Script spread(
+      Parse("(begin (define loop (lambda (x) (loop x))) "
+            "(pmap loop (list 1 2 3 4)))"),
+      Prelude());
+  spread.fuel().set_limit(10000);
+  BOOST_TEST(spread.run(100));
+  BOOST_CHECK_THROW(spread.result(), Exception);
+
+  Script spawned(
+      Parse("(begin (define loop (lambda (x) (loop x))) "
+            "(await (spawn loop 1)))"),
+      Prelude());
+  spawned.fuel().set_limit(10000);
+  BOOST_TEST(spawned.run(100));
+  BOOST_CHECK_THROW(spawned.result(), Exception);
+
+  // unbounded sync steps overdraw the slice rather than fail
+  Script fine(Parse("(map (lambda (x) (* x x)) (list 1 2 3))"), Prelude());
+  BOOST_TEST(fine.run(10));
+  BOOST_TEST(fine.steps() > 10u);
+  BOOST_TEST(fine.result() == Parse("(1 4 9)"));
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_parks_runaways)
+{
+  std::mutex mutex;
+  List results;
+  auto collect = [&](Expr result, std::exception_ptr error) {
+    std::lock_guard lock(mutex);
+    results.push_back(error ? Expr{String{"error"}} : result);
+  };
+  // goes before the results, as it fails the parked runaway on destruction
+  Scheduler scheduler(2, 100);
+
+  auto runaway = scheduler.submit(Parse(kRunaway), Prelude(), collect, 1, 5000);
+  for (int i = 0; i < 8; i++)
+    scheduler.submit(Parse(CountDown(300)), Prelude(), collect);
+  scheduler.submit(Parse("(car '())"), Prelude(), collect);
+
+  // the runaway does not hold up the others and ends up parked
+  scheduler.wait();
+  BOOST_TEST(results.size() == 9u);
+  BOOST_TEST(scheduler.parked() == 1u);
+  BOOST_TEST(runaway->steps() == 5000u);
+  BOOST_TEST(!runaway->done());
+
+  scheduler.refuel(runaway, 300);
+  scheduler.wait();
+  BOOST_TEST(runaway->steps() == 5300u);
+  BOOST_TEST(scheduler.parked() == 1u);
+
+  // a budget that runs out inside a builtin fails the script
+  results.clear();
+  scheduler.submit(
+      Parse("(begin (define loop (lambda (x) (loop x))) (map loop '(1)))"),
+      Prelude(),
+      collect,
+      1,
+      5000);
+  scheduler.wait();
+  BOOST_TEST(results == (List{Expr{String{"error"}}}));
+
+  // pool work keeps charging while each slice moves the limit
+  results.clear();
+  scheduler.submit(
+      Parse("(begin (define loop (lambda (x) (loop x))) "
+            "(define t (spawn loop 1)) " +
+            CountDown(2000) + " (await t))"),
+      Prelude(),
+      collect,
+      1,
+      50000);
+  scheduler.wait();
+  BOOST_TEST(results.size() + scheduler.parked() == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_fails_unfinished)
+{
+  std::atomic<int> failed{0};
+  auto count = [&](Expr, std::exception_ptr error) {
+    if (error)
+      failed++;
+  };
+  {
+    Scheduler scheduler(1, 100);
+    scheduler.submit(Parse(kRunaway), Prelude(), count, 1, 200);
+    scheduler.wait();
+    BOOST_TEST(scheduler.parked() == 1u);
+    for (int i = 0; i < 4; i++)
+      scheduler.submit(Parse(kRunaway), Prelude(), count);
+  }
+  // the parked script and every one still queued or preempted
+  BOOST_TEST(failed == 5);
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_weights)
+{
+  // on one thread the heavier script gets more slices per turn
+  Scheduler scheduler(1, 50);
+  std::vector<std::string> order;
+  auto record = [&](std::string name) {
+    return [&order, name](Expr, std::exception_ptr) { order.push_back(name); };
+  };
+  scheduler.submit(Parse(CountDown(2000)), Prelude(), record("light"), 1);
+  scheduler.submit(Parse(CountDown(2000)), Prelude(), record("heavy"), 4);
+  scheduler.wait();
+
+  BOOST_TEST(order == (std::vector<std::string>{"heavy", "light"}));
+}
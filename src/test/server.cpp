@@ -0,0 +1,163 @@
+#include "lib/server.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace afct;
+
+namespace {
+
+std::filesystem::path SocketPath()
+{
+  return std::filesystem::temp_directory_path() / "afct_server_test.sock";
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(server_eval)
+{
+  auto base = Prelude();
+  Eval(Parse("(define square (lambda (x) (* x x)))"), base);
+  Eval(Parse("(define lib (list #(\"a\" 1)))"), base);
+
+  ServerOptions options;
+  options.threads = 4;
+  options.timeout = std::chrono::milliseconds(100);
+  options.base = base;
+  Server server(SocketPath(), options);
+  std::thread thread([&] { server.run(); });
+
+  {
+    Client client(SocketPath());
+    BOOST_TEST(client.eval("(square 12)") == "144");
+    BOOST_TEST(client.eval("(list 1 \"two\" 3.5)") == "(1 \"two\" 3.5)");
+
+    // each request starts from a clean env
+    BOOST_TEST(client.eval("(begin (define x 1) x)") == "1");
+    BOOST_CHECK_THROW(client.eval("x"), Exception);
+    BOOST_CHECK_THROW(client.eval("(car"), Exception);
+    BOOST_CHECK_THROW(
+        client.eval("(begin (define loop (lambda () (loop))) (loop))"),
+        Exception);
+    BOOST_TEST(client.eval("(+ 1 2)") == "3");
+
+    // the deadline holds inside builtins, which can't be preempted
+    for (int i = 0; i < 6; i++)
+    {
+      BOOST_CHECK_THROW(
+          client.eval(
+              "(begin (define loop (lambda (x) (loop x))) (map loop '(1)))"),
+          Exception);
+    }
+
+    // tables in the base are shared by every request, so read-only
+    BOOST_CHECK_THROW(client.eval("(set! (car lib) \"a\" 2)"), Exception);
+    BOOST_TEST(client.eval("(get (car lib) \"a\")") == "1");
+    BOOST_TEST(
+        client.eval("(begin (define t #()) (set! t 1 2) t)") == "#(1 2)");
+  }
+
+  // idle connections don't hold workers
+  std::vector<std::unique_ptr<Client>> idle;
+  for (int i = 0; i < 8; i++)
+    idle.push_back(std::make_unique<Client>(SocketPath()));
+
+  std::vector<std::thread> clients;
+  std::atomic<int> correct{0};
+  for (int c = 0; c < 8; c++)
+  {
+    clients.emplace_back([&, c] {
+      Client client(SocketPath());
+      for (int i = 0; i < 20; i++)
+      {
+        auto n = c * 100 + i;
+        if (client.eval(fmt::format("(square {})", n)) ==
+            std::to_string(n * n))
+          correct++;
+      }
+    });
+  }
+  for (auto& client : clients)
+    client.join();
+  BOOST_TEST(correct == 160);
+  BOOST_TEST(idle.back()->eval("(square 3)") == "9");
+
+  // a live server keeps its socket
+  BOOST_CHECK_THROW(Server{SocketPath()}, Exception);
+  BOOST_TEST(idle.front()->eval("(+ 1 2)") == "3");
+
+  // idle open connections don't hold up shutdown
+  server.stop();
+  thread.join();
+  BOOST_CHECK_THROW(idle.front()->eval("(+ 1 2)"), Exception);
+}
+
+BOOST_AUTO_TEST_CASE(server_stop_cancels)
+{
+  ServerOptions options;
+  options.threads = 1;
+  Server server(SocketPath(), options);
+  std::thread thread([&] { server.run(); });
+
+  // with no timeout a runaway only ends when the server stops
+  std::thread runaway([] {
+    Client client(SocketPath());
+    BOOST_CHECK_THROW(
+        client.eval(
+            "(begin (define loop (lambda (x) (loop x))) (map loop '(1)))"),
+        Exception);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  server.stop();
+  thread.join();
+  runaway.join();
+}
+
+BOOST_AUTO_TEST_CASE(server_stalled_clients)
+{
+  ServerOptions options;
+  options.threads = 1;
+  Server server(SocketPath(), options);
+  std::thread thread([&] { server.run(); });
+
+  // clients that stop partway through a request hold no worker
+  std::vector<int> stalled;
+  for (int i = 0; i < 4; i++)
+  {
+    auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, SocketPath().c_str());
+    auto generic = reinterpret_cast<sockaddr*>(&address);
+    BOOST_REQUIRE(::connect(fd, generic, sizeof(address)) == 0);
+    char const partial[] = {10, 0};
+    BOOST_REQUIRE(::write(fd, partial, i % 2 + 1) > 0);
+    stalled.push_back(fd);
+  }
+
+  Client client(SocketPath());
+  BOOST_TEST(client.eval("(+ 1 2)") == "3");
+  BOOST_TEST(client.eval("(list 1 2)") == "(1 2)");
+
+  server.stop();
+  thread.join();
+  for (auto fd : stalled)
+    ::close(fd);
+}
+
+BOOST_AUTO_TEST_CASE(server_errors)
+{
+  BOOST_CHECK_THROW(Client("/nonexistent/afct.sock"), Exception);
+  BOOST_CHECK_THROW(Server(std::string(200, 'x')), Exception);
+}
@@ -0,0 +1,120 @@
+#include "lib/snapshot.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/function.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <filesystem>
+
+using namespace afct;
+
+namespace {
+
+uint64_t Word(std::string const& data, size_t offset)
+{
+  uint64_t word;
+  std::memcpy(&word, data.data() + offset, sizeof(word));
+  return word;
+}
+
+void SetWord(std::string& data, size_t offset, uint64_t word)
+{
+  std::memcpy(data.data() + offset, &word, sizeof(word));
+}
+
+auto const kLibrary = R"(
+  (begin
+    (define fact (lambda (n) (if (= n 0) 1 (* n (fact (- n 1))))))
+    (define adder (lambda (n) (lambda (x) (+ x n))))
+    (define add2 (adder 2))
+    (define config #("name" "afct" "ports" '(80 443)))
+    (define shared '(1 2 3))
+    (define both (list shared shared))
+    (define ops (list + car)))
+)";
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(snapshot_round_trip)
+{
+  auto env = Prelude();
+  Eval(Parse(kLibrary), env);
+  auto loaded = DecodeSnapshot(EncodeSnapshot(env));
+
+  BOOST_TEST(loaded->outer() == Builtins());
+  BOOST_TEST(Eval(Parse("(fact 10)"), loaded) == Expr{3628800});
+  BOOST_TEST(Eval(Parse("(add2 40)"), loaded) == Expr{42});
+  BOOST_TEST(
+      Eval(Parse("(begin (define add1 (adder 1)) (add1 1))"), loaded) ==
+      Expr{2});
+  BOOST_TEST(*loaded->find("config") == *env->find("config"));
+  BOOST_TEST(Eval(Parse("(apply (car ops) '(1 2))"), loaded) == Expr{3});
+
+  auto both = loaded->find("both")->get_list();
+  BOOST_TEST(&both[0].get_list() == &both[1].get_list());
+  auto add2 = loaded->find("add2")->get_lambda();
+  BOOST_TEST(add2.env->outer() == loaded);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_cycles)
+{
+  auto env = Prelude();
+  Eval(
+      Parse(R"((begin
+        (define t #("name" "t"))
+        (set! t "self" t)
+        (set! t "in" (list 1 t))))"),
+      env);
+  auto loaded = DecodeSnapshot(EncodeSnapshot(env));
+
+  auto& table = loaded->find("t")->get_table();
+  BOOST_TEST(table.size() == 3);
+  BOOST_TEST(&table.at(Expr{String{"self"}}).get_table() == &table);
+  auto& in = table.at(Expr{String{"in"}}).get_list();
+  BOOST_TEST(in.size() == 2);
+  BOOST_TEST(&in[1].get_table() == &table);
+  BOOST_TEST(Eval(Parse(R"((get (get t "self") "name"))"), loaded) ==
+             Expr{String{"t"}});
+
+  // breaks the cycles so neither copy leaks
+  table.clear();
+  env->find("t")->get_table().clear();
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_file)
+{
+  auto path = std::filesystem::temp_directory_path() / "afct_snapshot.img";
+  auto env = Prelude();
+  Eval(Parse(kLibrary), env);
+  WriteSnapshot(env, path);
+
+  auto loaded = ReadSnapshot(path);
+  BOOST_TEST(Eval(Parse("(fact 5)"), loaded) == Expr{120});
+  std::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_errors)
+{
+  auto env = Prelude();
+  Eval(Parse("(define xs (range 3))"), env);
+  BOOST_CHECK_THROW(EncodeSnapshot(env), Exception);
+
+  BOOST_CHECK_THROW(DecodeSnapshot("not a snapshot"), Exception);
+  auto data = EncodeSnapshot(Prelude());
+  BOOST_CHECK_THROW(DecodeSnapshot(data.substr(0, data.size() - 8)), Exception);
+  BOOST_CHECK_THROW(
+      ReadSnapshot(std::filesystem::path("/nonexistent/afct.img")), Exception);
+
+  // a lambda whose body leads back to itself
+  auto single = Env::Make(Builtins());
+  Eval(Parse("(define f (lambda (x) x))"), single);
+  auto lambda = EncodeSnapshot(single);
+  auto bindings = Word(lambda, Word(lambda, 24));
+  auto f = Word(lambda, bindings + 24);
+  BOOST_TEST(DecodeSnapshot(lambda)->find("f")->is_lambda());
+  SetWord(lambda, f + 16, f);
+  BOOST_CHECK_THROW(DecodeSnapshot(lambda), Exception);
+}
@@ -0,0 +1,115 @@
+#include "lib/task.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#include "util.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <thread>
+
+using namespace afct;
+
+BOOST_AUTO_TEST_CASE(task_spawn_await)
+{
+  ThreadPool pool(2);
+  auto task = Spawn(pool, [] { return Expr{42}; });
+  BOOST_TEST(IsTask(task));
+  BOOST_TEST(Await(task) == Expr{42});
+  BOOST_TEST(GetTask(task).ready());
+  BOOST_TEST(Await(task) == Expr{42});
+
+  auto failing = Spawn(pool, []() -> Expr { AFCT_ERROR("lookup failed"); });
+  try
+  {
+    Await(failing);
+    BOOST_FAIL("Expected exception");
+  }
+  catch (Exception const& e)
+  {
+    BOOST_TEST(std::string(e.what()) == "lookup failed");
+  }
+}
+
+BOOST_AUTO_TEST_CASE(task_nested)
+{
+  // awaits run tasks no worker has started inline, so one is enough
+  ThreadPool pool(1);
+  List outer;
+  for (int i = 0; i < 4; i++)
+  {
+    outer.push_back(Spawn(pool, [&pool, i] {
+      List inner;
+      for (int j = 0; j < 4; j++)
+        inner.push_back(Spawn(pool, [i, j] { return Expr{i * 4 + j}; }));
+      return Expr{AwaitAll(inner)};
+    }));
+  }
+
+  auto results = AwaitAll(outer);
+  BOOST_TEST(results.size() == 4);
+  BOOST_TEST(results[3] == Parse("(12 13 14 15)"));
+
+  // with no workers at all everything runs inline
+  ThreadPool none(0);
+  auto task = Spawn(none, [&none] {
+    return Await(Spawn(none, [] { return Expr{7}; }));
+  });
+  BOOST_TEST(Await(task) == Expr{7});
+
+  // a waiting thread doesn't pick up unrelated work, which here would
+  // await the task suspended beneath it
+  std::atomic<bool> go{false};
+  Expr first;
+  first = Spawn(pool, [&] {
+    auto inner = Spawn(pool, [&] {
+      go.wait(false);
+      return Expr{1};
+    });
+    return Await(inner);
+  });
+  auto second = Spawn(pool, [&] { return Await(first); });
+  std::thread release([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    go = true;
+    go.notify_all();
+  });
+  BOOST_TEST(Await(second) == Expr{1});
+  release.join();
+}
+
+BOOST_AUTO_TEST_CASE(task_builtins)
+{
+  auto code = R"(
+    (begin
+      (define lookup (lambda (t k) (get t k)))
+      (define data #("a" 1 "b" 2))
+      (define a (spawn lookup data "a"))
+      (define b (spawn lookup data "b"))
+      (+ (await a) (await b)))
+  )";
+  BOOST_TEST(EvalSimple(code) == Expr{3.0});
+
+  auto all = "(all (spawn + 1 2) (spawn (lambda () \"x\")))";
+  BOOST_TEST(EvalSimple(all) == Parse(R"((3.0 "x"))"));
+  BOOST_TEST(EvalSimple("(all (list (spawn + 1 2)))") == Parse("(3.0)"));
+
+  // spawns within spawns, awaited through the builtins
+  auto nested = R"(
+    (begin
+      (define leaf (lambda (x) (* x 2)))
+      (define mid (lambda (x) (await (spawn leaf x))))
+      (define top
+        (lambda (x) (+ (await (spawn mid x)) (await (spawn mid (+ x 1))))))
+      (define tasks (map (lambda (x) (spawn top x)) (list 1 2 3 4 5 6 7 8)))
+      (define later 1)
+      (all tasks))
+  )";
+  BOOST_TEST(
+      EvalSimple(nested) ==
+      Parse("(6.0 10.0 14.0 18.0 22.0 26.0 30.0 34.0)"));
+
+  BOOST_CHECK_THROW(EvalSimple("(await (spawn car '()))"), Exception);
+  BOOST_CHECK_THROW(EvalSimple("(all 1)"), Exception);
+}
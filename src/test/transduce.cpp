@@ -0,0 +1,57 @@
+#include "lib/transduce.hpp"
+
+#include "lib/eval.hpp"
+#include "lib/parse.hpp"
+#include "lib/prelude.hpp"
+#include "util.hpp"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using namespace afct;
+
+BOOST_AUTO_TEST_CASE(transduce_pipeline)
+{
+  auto xf = R"(
+    (comp
+      (filter (lambda (x) (> x 2)))
+      (map (lambda (x) (* x 10)))
+      (drop 1)
+      (take 2))
+  )";
+  auto env = Prelude();
+  Eval("(define xf " + std::string(xf) + ")", env);
+  BOOST_TEST(IsTransducer(env->find("xf").value()));
+
+  auto into = "(into '(0) xf '(1 2 3 4 5 6 7))";
+  BOOST_TEST(Eval(std::string(into), env) == Parse("(0 40 50)"));
+  auto sum = "(transduce xf + 0 '(1 2 3 4 5 6 7))";
+  BOOST_TEST(Eval(std::string(sum), env) == Expr{90.0});
+  auto seq = "(into '() xf (range))";
+  BOOST_TEST(Eval(std::string(seq), env) == Parse("(40 50)"));
+  auto empty = "(into '() (comp) '(1 2))";
+  BOOST_TEST(Eval(std::string(empty), env) == Parse("(1 2)"));
+}
+
+BOOST_AUTO_TEST_CASE(transduce_stops_early)
+{
+  auto env = Prelude();
+  Eval(std::string("(define calls (table))"), env);
+  auto code = R"(
+    (into '()
+      (comp (map (lambda (x) (set! calls x x))) (take 3))
+      '(1 2 3 4 5 6))
+  )";
+  BOOST_TEST(Eval(std::string(code), env) == Parse("(1 2 3)"));
+  BOOST_TEST(Eval(std::string("(length calls)"), env) == Expr{3});
+  BOOST_TEST(Eval(std::string("(into '() (take 0) '(1))"), env) == Parse("()"));
+}
+
+BOOST_AUTO_TEST_CASE(transduce_reduce)
+{
+  auto code = "(reduce (lambda (acc x) (cons x acc)) '() '(1 2))";
+  BOOST_TEST(EvalSimple(code) == Parse("(2 (1 ()))"));
+  BOOST_TEST(EvalSimple("(reduce + 0 (range 101))") == Expr{5050.0});
+  BOOST_TEST(EvalSimple("(reduce + 7 '())") == Expr{7});
+  BOOST_CHECK_THROW(EvalSimple("(transduce + + 0 '(1))"), Exception);
+  BOOST_CHECK_THROW(EvalSimple("((map car) '(1))"), Exception);
+}
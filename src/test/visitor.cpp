@@ -119,3 +119,49 @@ BOOST_AUTO_TEST_CASE(visitor)
                   "end list";
   BOOST_TEST(string == expected);
 }
+
+class Counter : public StaticVisitor
+{
+public:
+  size_t values{0};
+  size_t containers{0};
+  int64_t sum{0};
+
+  void int_value(int64_t value)
+  {
+    values++;
+    sum += value;
+  }
+
+  void string_value(std::string const&)
+  {
+    values++;
+  }
+
+  void start_list(size_t)
+  {
+    containers++;
+  }
+
+  void start_table(size_t)
+  {
+    containers++;
+  }
+};
+
+BOOST_AUTO_TEST_CASE(visitor_static)
+{
+  auto expr = Eval(std::string(R"((list 1 2 '(3 #("a" 4))))"), Prelude());
+
+  Counter counter;
+  Visit(expr, counter);
+  BOOST_TEST(counter.values == 5);
+  BOOST_TEST(counter.containers == 3);
+  BOOST_TEST(counter.sum == 10);
+
+  // the virtual interface goes through the same traversal
+  Visitor visitor;
+  IVisitor& erased = visitor;
+  Visit(expr, erased);
+  BOOST_TEST(!visitor.stream.str().empty());
+}